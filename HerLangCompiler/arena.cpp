@@ -0,0 +1,58 @@
+// arena.cpp - Bump allocator backing AST storage
+#include "arena.hpp"
+#include <cstdint>
+#include <cstring>
+
+static std::size_t padding(const char* p, std::size_t align) {
+    return (align - reinterpret_cast<std::uintptr_t>(p) % align) % align;
+}
+
+bool Arena::fits(std::size_t size, std::size_t align) const {
+    return cur_ && padding(cur_, align) + size <= left_;
+}
+
+void Arena::enter(std::size_t index) {
+    current_ = index;
+    cur_ = chunks_[index].data.get();
+    left_ = chunks_[index].size;
+}
+
+void* Arena::allocate(std::size_t size, std::size_t align) {
+    if (!fits(size, align)) {
+        // Move on to a recycled chunk that is big enough, or add a new one.
+        std::size_t next = cur_ ? current_ + 1 : 0;
+        while (next < chunks_.size() && chunks_[next].size < size + align) ++next;
+
+        if (next == chunks_.size()) {
+            std::size_t bytes = size + align > chunk_size_ ? size + align : chunk_size_;
+            chunks_.push_back({ std::make_unique<char[]>(bytes), bytes });
+            reserved_ += bytes;
+        }
+        enter(next);
+    }
+
+    char* p = cur_ + padding(cur_, align);
+    left_ -= static_cast<std::size_t>(p + size - cur_);
+    cur_ = p + size;
+    return p;
+}
+
+std::string_view Arena::copy(std::string_view s) {
+    if (s.empty()) return {};
+    char* p = static_cast<char*>(allocate(s.size(), 1));
+    std::memcpy(p, s.data(), s.size());
+    return std::string_view(p, s.size());
+}
+
+void Arena::reset() {
+    if (chunks_.empty()) return;
+    enter(0);
+}
+
+void Arena::release() {
+    chunks_.clear();
+    current_ = 0;
+    cur_ = nullptr;
+    left_ = 0;
+    reserved_ = 0;
+}
@@ -0,0 +1,45 @@
+// arena.hpp - Bump allocator backing AST storage
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Hands out memory by bumping a pointer through large chunks. Individual
+// allocations are never freed; everything goes away at once with the arena,
+// or is recycled by reset(). Only use it for trivially destructible data.
+class Arena {
+public:
+    explicit Arena(std::size_t chunk_size = 64 * 1024) : chunk_size_(chunk_size) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&&) noexcept = default;
+    Arena& operator=(Arena&&) noexcept = default;
+
+    void* allocate(std::size_t size, std::size_t align = alignof(std::max_align_t));
+    std::string_view copy(std::string_view s);
+
+    // Invalidates every allocation but keeps the chunks for reuse.
+    void reset();
+    // Invalidates every allocation and returns the chunks to the system.
+    void release();
+
+    std::size_t bytes_reserved() const { return reserved_; }
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        std::size_t size;
+    };
+
+    bool fits(std::size_t size, std::size_t align) const;
+    void enter(std::size_t index);
+
+    std::vector<Chunk> chunks_;
+    std::size_t current_ = 0;
+    char* cur_ = nullptr;
+    std::size_t left_ = 0;
+    std::size_t chunk_size_;
+    std::size_t reserved_ = 0;
+};
@@ -1,56 +1,190 @@
 // ast.hpp - AST structure for MyLang
 #pragma once
+#include "arena.hpp"
 #include "lexer.hpp"
-#include <string>
+#include <cstdint>
+#include <new>
+#include <string_view>
 #include <vector>
-#include <memory>
 
-struct Statement {
-    virtual ~Statement() = default;
+// Every node carries an explicit kind tag; passes switch on it instead of
+// probing with dynamic_cast. The meaning of `name`/`text` and of the child
+// list depends on the kind:
+enum class NodeKind : uint8_t {
+    Say,            // children: argument expressions, text: ending
+    Set,            // name: variable, children: zero or one initial value (default 0)
+    FunctionCall,   // name: callee, children: zero or one argument expression
+    FunctionDef,    // name, text: parameter (may be empty), children: body
+    StartBlock,     // children: body
+    StringLiteral,  // text: contents without quotes
+    Variable,       // name
+    Flush,          // no fields
+    NumberLiteral,  // text: spelling, e.g. "42", "-1.5"
+    Add,            // name: target variable, children: operand
+    Minus,          // name: target variable, children: operand
+    Multiply,       // name: target variable, children: operand
+    Divide,         // name: target variable, children: operand
+    Repeat,         // name: count variable, or text: count literal; children: body
+    ListDef,        // name: list, text: record type (set by fold_constants), children: element literals
+    ForEach,        // name: loop variable, text: list, children: body
+    Pipeline,       // name: new list, text: source list, children: Filter/Transform stages
+    Filter,         // name: element variable, text: operator, children: operand
+    Transform,      // name: element variable, text: operator, children: operand
+    Spawn,          // name: label (may be empty), children: body
+    AwaitAll,       // no fields
+    Yield,          // text: milliseconds
+    TypeDef,        // name: type, text: "columns" for struct-of-arrays lists, children: Field and Method nodes, or Case nodes
+    Field,          // name: field, text: its type as spelled ("String", "Number", "Float")
+    Method,         // name: method, text: type, children: body
+    RecordLiteral,  // name: type, or case of a type with cases; children: field values in order, as literals
+    Case,           // name: case, children: its Field nodes
+    Match,          // name: variable, text: its type (set by fold_constants), children: Arm nodes
+    Arm,            // name: case, "_" for any other; text: names bound to its fields, comma-separated; children: body
 };
 
-class SayStatement : public Statement {
-public:
-    std::vector<std::string> args;
-    std::vector<bool> is_vars;
-    std::string end;
-
-    SayStatement(const std::vector<std::string>& args,
-        const std::vector<bool>& is_vars,
-        const std::string& end)
-        : args(args), is_vars(is_vars), end(end) {}
-};
+inline bool is_loop(NodeKind kind) {
+    return kind == NodeKind::Repeat || kind == NodeKind::ForEach;
+}
 
+// A match_gently and each of its arms; exactly one arm runs.
+inline bool is_match(NodeKind kind) {
+    return kind == NodeKind::Match || kind == NodeKind::Arm;
+}
 
-struct SetStatement : public Statement {
-    std::string var;
-    SetStatement(const std::string& var) : var(var) {}
-};
+// Statements whose children are a nested body of statements (for a Match,
+// of arms, which hold the statements).
+inline bool has_body(NodeKind kind) {
+    return is_loop(kind) || kind == NodeKind::Spawn || is_match(kind);
+}
+
+// A record field or method is named by a path, "p.age" or "self.greet",
+// kept whole in Node::name.
+inline bool is_path(std::string_view name) {
+    return name.find('.') != std::string_view::npos;
+}
+
+inline std::string_view path_base(std::string_view name) {
+    return name.substr(0, name.find('.'));
+}
 
-struct FunctionCall : Statement {
-    std::string name;
-    std::string arg;
-    TokenType arg_type;
-    FunctionCall(const std::string& n, const std::string& a, TokenType t = TokenType::EOFToken)
-        : name(n), arg(a), arg_type(t) {}
+inline std::string_view path_member(std::string_view name) {
+    return name.substr(name.find('.') + 1);
+}
+
+// The names an Arm binds, from its text, in the order of its case's
+// fields; "_" binds nothing. Empty when the arm binds no names at all.
+inline std::vector<std::string_view> arm_bindings(std::string_view text) {
+    std::vector<std::string_view> names;
+    while (!text.empty()) {
+        size_t comma = text.find(',');
+        names.push_back(text.substr(0, comma));
+        text = comma == std::string_view::npos ? std::string_view{} : text.substr(comma + 1);
+    }
+    return names;
+}
+
+// Static type of a numeric variable, filled in by fold_constants on Set and
+// arithmetic nodes (the type of the variable they assign). On ListDef,
+// ForEach and Pipeline it is the element type, None for a list of text; on
+// Filter and Transform, the type of the element going into the stage.
+enum class NumType : uint8_t {
+    None,
+    Int,     // 64-bit signed
+    Float,   // double
 };
 
+using NodeId = uint32_t;
 
-struct FunctionDef : public Statement {
-    std::string name;
-    std::string param;
-    std::vector<std::shared_ptr<Statement>> body;
-    FunctionDef(const std::string& name, const std::string& param,
-        const std::vector<std::shared_ptr<Statement>>& body)
-        : name(name), param(param), body(body) {}
+struct Node {
+    NodeKind kind;
+    NumType type = NumType::None;
+    uint32_t first = 0;   // start of this node's child list in AST::child_ids
+    uint32_t count = 0;   // number of children
+    int line = 0;
+    std::string_view name;
+    std::string_view text;
 };
 
-struct StartBlock : public Statement {
-    std::vector<std::shared_ptr<Statement>> body;
-    StartBlock(const std::vector<std::shared_ptr<Statement>>& body)
-        : body(body) {}
+// A `repeat` whose count folding has found to be zero or less. Folding
+// spells a known count as a plain integer literal.
+inline bool never_runs(const Node& loop) {
+    return loop.kind == NodeKind::Repeat && loop.name.empty() && !loop.text.empty() &&
+        (loop.text == "0" || loop.text[0] == '-');
+}
+
+struct ChildRange {
+    const NodeId* first;
+    const NodeId* last;
+
+    const NodeId* begin() const { return first; }
+    const NodeId* end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+    bool empty() const { return first == last; }
+    NodeId operator[](size_t i) const { return first[i]; }
 };
 
-struct AST {
-    std::vector<std::shared_ptr<Statement>> statements;
+// Nodes are bump-allocated from the AST's arena in fixed-size chunks and refer
+// to each other by index, so growing the tree never moves existing nodes.
+// Child lists are contiguous runs in a second pool, so a block body is a
+// single slice. Strings point into the source buffer, which must outlive the
+// AST, or into the arena when a pass synthesizes them. Destroying the AST
+// releases everything at once.
+class AST {
+public:
+    std::vector<NodeId> statements;
+
+    AST() : arena_(256 * 1024) {}
+
+    const Node& operator[](NodeId id) const { return node_chunks_[id / kNodesPerChunk][id % kNodesPerChunk]; }
+    Node& operator[](NodeId id) { return node_chunks_[id / kNodesPerChunk][id % kNodesPerChunk]; }
+
+    ChildRange children(const Node& node) const {
+        const NodeId* first = child_ids_.data() + node.first;
+        return { first, first + node.count };
+    }
+    ChildRange children(NodeId id) const { return children((*this)[id]); }
+
+    NodeId add(const Node& node) {
+        if (node_count_ % kNodesPerChunk == 0) {
+            node_chunks_.push_back(static_cast<Node*>(
+                arena_.allocate(sizeof(Node) * kNodesPerChunk, alignof(Node))));
+        }
+        new (node_chunks_.back() + node_count_ % kNodesPerChunk) Node(node);
+        return node_count_++;
+    }
+
+    // Child lists are collected on a scratch stack while a block is parsed
+    // (nested blocks finish first) and then copied out in one piece.
+    size_t open_list() const { return scratch_.size(); }
+    void push_child(NodeId id) { scratch_.push_back(id); }
+    void close_list(NodeId parent, size_t mark) {
+        Node& node = (*this)[parent];
+        node.first = static_cast<uint32_t>(child_ids_.size());
+        node.count = static_cast<uint32_t>(scratch_.size() - mark);
+        child_ids_.insert(child_ids_.end(), scratch_.begin() + mark, scratch_.end());
+        scratch_.resize(mark);
+    }
+
+    std::string_view intern(std::string_view s) { return arena_.copy(s); }
+
+    // Empties the tree but keeps its memory, for building the next one.
+    void clear() {
+        statements.clear();
+        arena_.reset();
+        node_chunks_.clear();
+        node_count_ = 0;
+        child_ids_.clear();
+        scratch_.clear();
+    }
+
+    size_t node_count() const { return node_count_; }
+
+private:
+    static constexpr uint32_t kNodesPerChunk = 4096;
+
+    Arena arena_;
+    std::vector<Node*> node_chunks_;
+    uint32_t node_count_ = 0;
+    std::vector<NodeId> child_ids_;
+    std::vector<NodeId> scratch_;
 };
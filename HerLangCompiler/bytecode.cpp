@@ -0,0 +1,870 @@
+// bytecode.cpp - AST to register bytecode
+#include "bytecode.hpp"
+#include "records.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+class BytecodeCompiler {
+public:
+    BytecodeCompiler(const AST& ast, const CodegenOptions& options) : ast_(ast), options_(options) {}
+
+    BytecodeProgram compile();
+
+private:
+    [[noreturn]] void fail(const Node& node, const std::string& message) const {
+        throw std::runtime_error("line " + std::to_string(node.line) + ": " + message);
+    }
+
+    void emit(Op op, uint16_t a = 0, uint32_t b = 0) {
+        Instr instr;
+        instr.op = op;
+        instr.a = a;
+        instr.b = b;
+        program_.code.push_back(instr);
+        flushed_ = false;
+    }
+
+    // A Flush straight after another one has nothing to hand over. Nothing
+    // can jump in between: a jump target is only ever placed after emitting
+    // a jump, which clears flushed_, or at the entry of a function.
+    void emit_flush() {
+        if (!flushed_) emit(Op::Flush);
+        flushed_ = true;
+    }
+
+    uint32_t constant(std::string_view text);
+    std::string_view name(std::string text);
+    uint16_t new_register(const Node& at);
+    uint16_t variable(const Node& var) const { return variable(var.name, var); }
+    uint16_t variable(std::string_view name, const Node& at) const;
+    uint16_t scratch(const Node& at);
+    uint16_t hoisted(std::string_view text, char type) const;
+    void hoist_literals(const Node& loop);
+    void hoist(const Node& at, std::string_view text, char type);
+    void declare_numbers(const Node& loop);
+    void bind(std::string_view name, uint16_t reg, NumType type);
+    void unbind(std::string_view name);
+    void load_number(uint16_t reg, std::string_view text, NumType type);
+    uint16_t number(const Node& operand, NumType type);
+
+    void function(uint32_t index, const Node& def, bool is_start);
+    void statement(const Node& stmt);
+    void say(const Node& stmt);
+    void set(const Node& stmt);
+    void arithmetic(const Node& stmt);
+    void repeat(const Node& loop);
+    void pack(std::string& packed, const Node& item, NumType type);
+    void list(const Node& def);
+    void pipeline(const Node& def);
+    void for_each(const Node& loop);
+    void match(const Node& stmt);
+    void spawn(const Node& block);
+    void find_used(ChildRange body, std::vector<std::string_view>& used) const;
+    void call(const Node& stmt);
+    void flush_pending();
+
+    const AST& ast_;
+    const CodegenOptions& options_;
+    BytecodeProgram program_;
+    std::unordered_map<std::string_view, uint32_t> functions_;
+    std::unordered_map<std::string, uint32_t> constant_ids_;
+    RecordTable records_;
+    // Names made up here, "Person.greet" for a method and "p.age" for a
+    // field, which the maps below refer to.
+    std::deque<std::string> names_;
+
+    // State of the function being compiled.
+    std::unordered_map<std::string_view, uint16_t> locals_;
+    uint32_t registers_ = 0;
+    uint16_t scratch_ = kNoRegister;   // holds literal operands
+    std::unordered_map<std::string_view, NumType> numbers_;
+    // Variables set elsewhere in the function that a loop or match arm
+    // variable of the same name hides in its body.
+    std::unordered_map<std::string_view, std::pair<uint16_t, NumType>> hidden_;
+    // Lists of records, held one column per field in consecutive
+    // registers starting at the list's own; for a type with cases, the
+    // tags and then one column per field of each case.
+    std::unordered_map<std::string_view, const RecordType*> record_lists_;
+    // Literal operands used inside the loop being compiled, loaded once
+    // into their own registers before it, keyed by type tag and spelling.
+    std::unordered_map<std::string, uint16_t> hoisted_;
+    int loop_depth_ = 0;
+    // Literal output not yet emitted. Like the C++ generator, runs of
+    // literal text become one PrintStr; under FlushPolicy::Line the flush
+    // for every line in the run is issued once, after it.
+    std::string pending_;
+    bool pending_line_ = false;
+    bool flushed_ = false;   // the last instruction is a Flush
+};
+
+uint32_t BytecodeCompiler::constant(std::string_view text) {
+    auto [it, fresh] = constant_ids_.emplace(std::string(text), static_cast<uint32_t>(program_.constants.size()));
+    if (fresh) {
+        program_.constants.push_back({ static_cast<uint32_t>(program_.strings.size()), static_cast<uint32_t>(text.size()) });
+        program_.strings += text;
+    }
+    return it->second;
+}
+
+std::string_view BytecodeCompiler::name(std::string text) {
+    return names_.emplace_back(std::move(text));
+}
+
+uint16_t BytecodeCompiler::new_register(const Node& at) {
+    if (registers_ >= kNoRegister) fail(at, "too many variables in one function");
+    return static_cast<uint16_t>(registers_++);
+}
+
+uint16_t BytecodeCompiler::variable(std::string_view name, const Node& at) const {
+    auto it = locals_.find(name);
+    if (it == locals_.end()) fail(at, "unknown variable '" + std::string(name) + "'");
+    return it->second;
+}
+
+uint16_t BytecodeCompiler::scratch(const Node& at) {
+    if (scratch_ == kNoRegister) scratch_ = new_register(at);
+    return scratch_;
+}
+
+// Type tags for hoisted literals: a string, an integer or a double.
+static char literal_tag(NumType type) {
+    return type == NumType::Float ? 'f' : 'i';
+}
+
+static NumType literal_type(std::string_view spelling) {
+    return spelling.find_first_of(".e") != std::string_view::npos ? NumType::Float : NumType::Int;
+}
+
+uint16_t BytecodeCompiler::hoisted(std::string_view text, char type) const {
+    if (hoisted_.empty()) return kNoRegister;
+    auto it = hoisted_.find(type + std::string(text));
+    return it != hoisted_.end() ? it->second : kNoRegister;
+}
+
+void BytecodeCompiler::hoist(const Node& at, std::string_view text, char type) {
+    auto [it, fresh] = hoisted_.emplace(type + std::string(text), kNoRegister);
+    if (!fresh) return;
+    it->second = new_register(at);
+    if (type == 's') emit(Op::LoadStr, it->second, constant(text));
+    else load_number(it->second, text, type == 'f' ? NumType::Float : NumType::Int);
+}
+
+// The operands a loop body would otherwise load on every iteration: literal
+// call arguments and the literal right-hand sides of arithmetic.
+void BytecodeCompiler::hoist_literals(const Node& loop) {
+    for (NodeId id : ast_.children(loop)) {
+        const Node& stmt = ast_[id];
+        if (has_body(stmt.kind)) {
+            hoist_literals(stmt);
+        }
+        else if (stmt.kind == NodeKind::FunctionCall && stmt.count) {
+            const Node& arg = ast_[ast_.children(stmt)[0]];
+            if (arg.kind == NodeKind::StringLiteral) hoist(arg, arg.text, 's');
+            else if (arg.kind == NodeKind::NumberLiteral) hoist(arg, arg.text, literal_tag(literal_type(arg.text)));
+        }
+        else if (stmt.kind == NodeKind::Add || stmt.kind == NodeKind::Minus ||
+            stmt.kind == NodeKind::Multiply || stmt.kind == NodeKind::Divide) {
+            const Node& operand = ast_[ast_.children(stmt)[0]];
+            if (operand.kind == NodeKind::NumberLiteral) hoist(operand, operand.text, literal_tag(stmt.type));
+        }
+    }
+}
+
+// A variable first set inside a loop still exists after it, holding zero
+// if the loop never ran, as in generated C++.
+void BytecodeCompiler::declare_numbers(const Node& loop) {
+    for (NodeId id : ast_.children(loop)) {
+        const Node& stmt = ast_[id];
+        if (is_loop(stmt.kind) || is_match(stmt.kind)) {
+            declare_numbers(stmt);
+        }
+        else if (stmt.kind == NodeKind::Set && !locals_.count(stmt.name)) {
+            uint16_t reg = locals_[stmt.name] = new_register(stmt);
+            numbers_[stmt.name] = stmt.type;
+            load_number(reg, "0", stmt.type);
+        }
+    }
+}
+
+void BytecodeCompiler::bind(std::string_view name, uint16_t reg, NumType type) {
+    auto it = locals_.find(name);
+    if (it != locals_.end()) hidden_[name] = { it->second, numbers_[name] };
+    locals_[name] = reg;
+    numbers_[name] = type;
+}
+
+void BytecodeCompiler::unbind(std::string_view name) {
+    locals_.erase(name);
+    numbers_.erase(name);
+    auto it = hidden_.find(name);
+    if (it == hidden_.end()) return;
+    locals_[name] = it->second.first;
+    numbers_[name] = it->second.second;
+    hidden_.erase(it);
+}
+
+// Numbers that fit in 32 bits are immediates; the rest are 8-byte constants.
+void BytecodeCompiler::load_number(uint16_t reg, std::string_view text, NumType type) {
+    std::string spelled(text);
+    char bytes[8];
+    if (type == NumType::Float) {
+        double f = std::strtod(spelled.c_str(), nullptr);
+        std::memcpy(bytes, &f, sizeof bytes);
+        emit(Op::LoadF64, reg, constant({ bytes, sizeof bytes }));
+        return;
+    }
+
+    int64_t i = std::strtoll(spelled.c_str(), nullptr, 10);
+    if (i >= INT32_MIN && i <= INT32_MAX) {
+        emit(Op::LoadInt, reg, static_cast<uint32_t>(static_cast<int32_t>(i)));
+        return;
+    }
+    std::memcpy(bytes, &i, sizeof bytes);
+    emit(Op::LoadI64, reg, constant({ bytes, sizeof bytes }));
+}
+
+// A register holding `operand` as a `type`, converting integers to doubles
+// on the way.
+uint16_t BytecodeCompiler::number(const Node& operand, NumType type) {
+    if (operand.kind == NodeKind::NumberLiteral) {
+        uint16_t reg = hoisted(operand.text, literal_tag(type));
+        if (reg != kNoRegister) return reg;
+        reg = scratch(operand);
+        load_number(reg, operand.text, type);
+        return reg;
+    }
+
+    uint16_t reg = variable(operand);
+    if (type == NumType::Float && numbers_[operand.name] != NumType::Float) {
+        uint16_t converted = scratch(operand);
+        emit(Op::ToFloat, converted, reg);
+        return converted;
+    }
+    return reg;
+}
+
+void BytecodeCompiler::flush_pending() {
+    if (!pending_.empty()) emit(Op::PrintStr, 0, constant(pending_));
+    if (pending_line_) emit_flush();
+    pending_.clear();
+    pending_line_ = false;
+}
+
+void BytecodeCompiler::say(const Node& stmt) {
+    for (NodeId id : ast_.children(stmt)) {
+        const Node& arg = ast_[id];
+        if (arg.kind == NodeKind::StringLiteral) {
+            pending_ += arg.text;
+        }
+        else {
+            uint16_t reg = variable(arg);
+            flush_pending();
+            emit(Op::Print, reg);
+        }
+    }
+
+    if (stmt.text == "\\n") {
+        pending_ += '\n';
+        if (options_.flush == FlushPolicy::Line) pending_line_ = true;
+    }
+    else {
+        pending_ += stmt.text;
+    }
+}
+
+void BytecodeCompiler::set(const Node& stmt) {
+    auto it = locals_.find(stmt.name);
+    uint16_t reg = it != locals_.end() ? it->second : (locals_[stmt.name] = new_register(stmt));
+    numbers_[stmt.name] = stmt.type;
+
+    if (!stmt.count) {
+        load_number(reg, "0", stmt.type);
+        return;
+    }
+    const Node& value = ast_[ast_.children(stmt)[0]];
+    if (value.kind == NodeKind::NumberLiteral) load_number(reg, value.text, stmt.type);
+    else if (stmt.type == NumType::Float && numbers_[value.name] != NumType::Float) emit(Op::ToFloat, reg, variable(value));
+    else emit(Op::Move, reg, variable(value));
+}
+
+void BytecodeCompiler::arithmetic(const Node& stmt) {
+    bool is_float = stmt.type == NumType::Float;
+    Op op;
+    switch (stmt.kind) {
+    case NodeKind::Add:      op = is_float ? Op::AddF : Op::AddI; break;
+    case NodeKind::Minus:    op = is_float ? Op::SubF : Op::SubI; break;
+    case NodeKind::Multiply: op = is_float ? Op::MulF : Op::MulI; break;
+    default:                 op = is_float ? Op::DivF : Op::DivI; break;
+    }
+    uint16_t target = variable(stmt);
+    uint16_t source = number(ast_[ast_.children(stmt)[0]], stmt.type);
+    // DivI can end the program, so everything said before it must be out.
+    if (op == Op::DivI) flush_pending();
+    emit(op, target, source);
+}
+
+// Counts a copy of the trip count down to zero:
+//
+//         Move/LoadInt  counter, count
+//         Jump          test
+//   body: ...
+//   test: Loop          counter, body
+void BytecodeCompiler::repeat(const Node& loop) {
+    declare_numbers(loop);
+    if (never_runs(loop)) return;
+    if (loop_depth_++ == 0) hoist_literals(loop);
+
+    uint16_t counter = new_register(loop);
+    if (!loop.name.empty()) emit(Op::Move, counter, variable(loop));
+    else load_number(counter, loop.text, NumType::Int);
+    flush_pending();
+
+    size_t jump = program_.code.size();
+    emit(Op::Jump);
+    auto body = static_cast<uint32_t>(program_.code.size());
+    for (NodeId id : ast_.children(loop)) statement(ast_[id]);
+    flush_pending();
+
+    program_.code[jump].b = static_cast<uint32_t>(program_.code.size());
+    emit(Op::Loop, counter, body);
+    if (--loop_depth_ == 0) hoisted_.clear();
+}
+
+static Op list_op(NumType type) {
+    return type == NumType::None ? Op::ListStr : type == NumType::Float ? Op::ListF64 : Op::ListI64;
+}
+
+// Appends one element to a list constant: an 8-byte number, or the u32
+// index of the constant holding a string.
+void BytecodeCompiler::pack(std::string& packed, const Node& item, NumType type) {
+    char bytes[8];
+    if (type == NumType::None) {
+        uint32_t index = constant(item.text);
+        std::memcpy(bytes, &index, sizeof index);
+        packed.append(bytes, sizeof index);
+    }
+    else if (type == NumType::Float) {
+        double f = std::strtod(std::string(item.text).c_str(), nullptr);
+        std::memcpy(bytes, &f, sizeof f);
+        packed.append(bytes, sizeof f);
+    }
+    else {
+        int64_t i = std::strtoll(std::string(item.text).c_str(), nullptr, 10);
+        std::memcpy(bytes, &i, sizeof i);
+        packed.append(bytes, sizeof i);
+    }
+}
+
+// The column of field `k` of case `index` in a list of values of a type
+// with cases; column 0 holds the tags.
+static size_t case_column(const RecordType& type, size_t index, size_t k) {
+    size_t column = 1;
+    for (size_t c = 0; c < index; ++c) column += type.cases[c].fields.size();
+    return column + k;
+}
+
+// The elements are packed into one constant. A list of records becomes
+// one list per field, in consecutive registers.
+void BytecodeCompiler::list(const Node& def) {
+    if (!def.text.empty() && records_.find(def.text)->has_cases()) {
+        // Values of other cases fill a case's columns with "" or 0.
+        const RecordType* type = records_.find(def.text);
+        record_lists_[def.name] = type;
+        std::string tags;
+        for (NodeId id : ast_.children(def)) {
+            int64_t tag = type->find_case(ast_[id].name);
+            tags.append(reinterpret_cast<const char*>(&tag), sizeof tag);
+        }
+        uint16_t reg = locals_[def.name] = new_register(def);
+        emit(Op::ListI64, reg, constant(tags));
+        for (size_t index = 0; index < type->cases.size(); ++index) {
+            const std::vector<RecordField>& fields = type->cases[index].fields;
+            for (size_t k = 0; k < fields.size(); ++k) {
+                Node blank;
+                blank.text = fields[k].type == NumType::None ? "" : "0";
+                std::string packed;
+                for (NodeId id : ast_.children(def)) {
+                    bool mine = ast_[id].name == type->cases[index].name;
+                    pack(packed, mine ? ast_[ast_.children(id)[k]] : blank, fields[k].type);
+                }
+                emit(list_op(fields[k].type), new_register(def), constant(packed));
+            }
+        }
+        return;
+    }
+    if (!def.text.empty()) {
+        const RecordType* type = records_.find(def.text);
+        record_lists_[def.name] = type;
+        for (size_t k = 0; k < type->fields.size(); ++k) {
+            std::string packed;
+            for (NodeId id : ast_.children(def)) pack(packed, ast_[ast_.children(id)[k]], type->fields[k].type);
+            uint16_t reg = new_register(def);
+            if (k == 0) locals_[def.name] = reg;
+            emit(list_op(type->fields[k].type), reg, constant(packed));
+        }
+        return;
+    }
+
+    std::string packed;
+    for (NodeId id : ast_.children(def)) pack(packed, ast_[id], def.type);
+    uint16_t reg = locals_[def.name] = new_register(def);
+    emit(list_op(def.type), reg, constant(packed));
+}
+
+static StageOp stage_op(std::string_view op) {
+    if (op == "<") return StageOp::Less;
+    if (op == "<=") return StageOp::LessEqual;
+    if (op == ">") return StageOp::Greater;
+    if (op == ">=") return StageOp::GreaterEqual;
+    if (op == "==") return StageOp::Equal;
+    if (op == "!=") return StageOp::NotEqual;
+    if (op == "contains") return StageOp::Contains;
+    if (op == "starts_with") return StageOp::StartsWith;
+    if (op == "ends_with") return StageOp::EndsWith;
+    if (op == "+") return StageOp::Add;
+    if (op == "-") return StageOp::Sub;
+    if (op == "*") return StageOp::Mul;
+    return StageOp::Div;
+}
+
+// Describes the stages in one constant for a single Pipeline instruction.
+// A comparison works in doubles if either side is one; a calculation in
+// the type of what it makes. Number operands are loaded, in that type,
+// into registers of their own first, as the VM reads them only once.
+void BytecodeCompiler::pipeline(const Node& def) {
+    uint32_t source = variable(def.text, def);
+    std::string packed(reinterpret_cast<const char*>(&source), sizeof source);
+
+    ChildRange stages = ast_.children(def);
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const Node& node = ast_[stages[i]];
+        const Node& operand = ast_[ast_.children(node)[0]];
+        PipelineStage stage;
+        stage.op = stage_op(node.text);
+
+        if (operand.kind == NodeKind::StringLiteral) {
+            stage.type = NumType::None;
+            stage.operand = StageOperand::Text;
+            stage.index = constant(operand.text);
+        }
+        else {
+            bool is_element = operand.kind == NodeKind::Variable && operand.name == node.name;
+            NumType operand_type = operand.kind == NodeKind::NumberLiteral ? literal_type(operand.text)
+                : is_element ? node.type : numbers_[operand.name];
+            if (node.kind == NodeKind::Transform) stage.type = i + 1 < stages.size() ? ast_[stages[i + 1]].type : def.type;
+            else stage.type = node.type == NumType::Float || operand_type == NumType::Float ? NumType::Float : NumType::Int;
+
+            if (is_element) {
+                stage.operand = StageOperand::Element;
+            }
+            else {
+                stage.operand = StageOperand::Register;
+                if (operand.kind == NodeKind::Variable && operand_type == stage.type) {
+                    stage.index = variable(operand);
+                }
+                else {
+                    uint16_t reg = new_register(operand);
+                    if (operand.kind == NodeKind::NumberLiteral) load_number(reg, operand.text, stage.type);
+                    else emit(Op::ToFloat, reg, variable(operand));
+                    stage.index = reg;
+                }
+            }
+        }
+        packed.append(reinterpret_cast<const char*>(&stage), sizeof stage);
+    }
+
+    // Dividing by zero can end the program, so everything said before must be out.
+    flush_pending();
+    uint16_t reg = locals_[def.name] = new_register(def);
+    emit(Op::Pipeline, reg, constant(packed));
+}
+
+// Walks a copy of the list with an index, in three consecutive registers:
+//
+//         Move     it, list
+//         LoadInt  it+1, 0
+//         Jump     test
+//   body: ...                 (the loop variable is it+2)
+//   test: Next     it, body
+//
+// Over a list of records, only the columns of the fields the body reads
+// are walked, each with its own three registers. The first one's Next
+// enters the body, where the others step along with a Next that goes on
+// to the following instruction either way. Over a list of a type with
+// cases, the tags are walked as the loop variable itself, along with the
+// columns of the fields a match_gently binds, as "p.Case.field".
+void BytecodeCompiler::for_each(const Node& loop) {
+    declare_numbers(loop);
+    if (loop_depth_++ == 0) hoist_literals(loop);
+
+    uint16_t list = variable(loop.text, loop);
+    auto records = record_lists_.find(loop.text);
+    const RecordType* type = records != record_lists_.end() ? records->second : nullptr;
+    std::vector<size_t> columns;
+    std::vector<std::pair<std::string_view, NumType>> vars;
+    if (type && type->has_cases()) {
+        columns.push_back(0);
+        vars.emplace_back(loop.name, NumType::Int);
+        std::vector<std::vector<bool>> bound = used_case_fields(ast_, ast_.children(loop), loop.name, *type);
+        for (size_t index = 0; index < bound.size(); ++index) {
+            const RecordCase& value = type->cases[index];
+            for (size_t k = 0; k < bound[index].size(); ++k) {
+                if (!bound[index][k]) continue;
+                columns.push_back(case_column(*type, index, k));
+                vars.emplace_back(name(std::string(loop.name) + "." + value.name + "." + value.fields[k].name),
+                    value.fields[k].type);
+            }
+        }
+    }
+    else if (type) {
+        std::vector<bool> used = used_fields(ast_, ast_.children(loop), loop.name, *type);
+        for (size_t k = 0; k < used.size(); ++k) {
+            if (used[k]) columns.push_back(k);
+        }
+        if (columns.empty()) columns.push_back(0);   // still counts the records
+        for (size_t k : columns) {
+            vars.emplace_back(name(std::string(loop.name) + "." + type->fields[k].name), type->fields[k].type);
+        }
+    }
+    else {
+        columns.push_back(0);
+        vars.emplace_back(loop.name, loop.type);
+    }
+
+    std::vector<uint16_t> walkers;
+    for (size_t k : columns) {
+        uint16_t it = new_register(loop);
+        new_register(loop);
+        new_register(loop);
+        emit(Op::Move, it, static_cast<uint32_t>(list + k));
+        emit(Op::LoadInt, static_cast<uint16_t>(it + 1), 0);
+        walkers.push_back(it);
+    }
+    flush_pending();
+
+    size_t jump = program_.code.size();
+    emit(Op::Jump);
+    auto body = static_cast<uint32_t>(program_.code.size());
+    for (size_t c = 1; c < walkers.size(); ++c) {
+        emit(Op::Next, walkers[c], static_cast<uint32_t>(program_.code.size() + 1));
+    }
+    for (size_t c = 0; c < walkers.size(); ++c) {
+        bind(vars[c].first, static_cast<uint16_t>(walkers[c] + 2), vars[c].second);
+    }
+    for (NodeId id : ast_.children(loop)) statement(ast_[id]);
+    for (const auto& var : vars) unbind(var.first);
+    flush_pending();
+
+    program_.code[jump].b = static_cast<uint32_t>(program_.code.size());
+    emit(Op::Next, walkers[0], body);
+    if (--loop_depth_ == 0) hoisted_.clear();
+}
+
+// A Switch jumps through a table with an entry per case, each the start
+// of its arm or of `case _`:
+//
+//         Switch  tag, table
+//         Jump    end            (a tag past the table)
+//   arm:  ...                    (its names are the loop's registers)
+//         Jump    end
+//   ...
+//   end:
+void BytecodeCompiler::match(const Node& stmt) {
+    const RecordType& type = *records_.find(stmt.text);
+    uint16_t tag = variable(stmt);
+    flush_pending();
+    size_t dispatch = program_.code.size();
+    emit(Op::Switch, tag);
+
+    constexpr uint32_t kUnset = UINT32_MAX;
+    std::vector<uint32_t> targets(type.cases.size(), kUnset);
+    uint32_t others = kUnset;
+    std::vector<size_t> exits{ program_.code.size() };
+    emit(Op::Jump);
+    for (NodeId id : ast_.children(stmt)) {
+        const Node& arm = ast_[id];
+        auto start = static_cast<uint32_t>(program_.code.size());
+        std::vector<std::string_view> bound;
+        if (arm.name == "_") {
+            others = start;
+        }
+        else {
+            int index = type.find_case(arm.name);
+            targets[index] = start;
+            std::vector<std::string_view> names = arm_bindings(arm.text);
+            for (size_t k = 0; k < names.size(); ++k) {
+                if (names[k] == "_") continue;
+                const RecordField& field = type.cases[index].fields[k];
+                bind(names[k], variable(std::string(stmt.name) + "." + std::string(arm.name) + "." + field.name, arm),
+                    field.type);
+                bound.push_back(names[k]);
+            }
+        }
+        for (NodeId body : ast_.children(arm)) statement(ast_[body]);
+        flush_pending();
+        for (std::string_view name : bound) unbind(name);
+        exits.push_back(program_.code.size());
+        emit(Op::Jump);
+    }
+    // The last arm runs on into the end.
+    program_.code.pop_back();
+    exits.pop_back();
+
+    auto end = static_cast<uint32_t>(program_.code.size());
+    for (size_t at : exits) program_.code[at].b = end;
+    std::string table;
+    for (uint32_t target : targets) {
+        if (target == kUnset) target = others != kUnset ? others : end;
+        table.append(reinterpret_cast<const char*>(&target), sizeof target);
+    }
+    program_.code[dispatch].b = constant(table);
+}
+
+// Every variable a body reads or changes, nested bodies included.
+void BytecodeCompiler::find_used(ChildRange body, std::vector<std::string_view>& used) const {
+    for (NodeId id : body) {
+        const Node& stmt = ast_[id];
+        if (stmt.kind == NodeKind::Set || stmt.kind == NodeKind::Add || stmt.kind == NodeKind::Minus ||
+            stmt.kind == NodeKind::Multiply || stmt.kind == NodeKind::Divide || stmt.kind == NodeKind::Repeat ||
+            stmt.kind == NodeKind::Match) {
+            used.push_back(stmt.name);
+        }
+        if (has_body(stmt.kind)) {
+            find_used(ast_.children(stmt), used);
+            continue;
+        }
+        for (NodeId operand : ast_.children(stmt)) {
+            if (ast_[operand].kind == NodeKind::Variable) used.push_back(ast_[operand].name);
+        }
+    }
+}
+
+// A spawned block runs to the end right where it is spawned, which is one
+// of the orders the worker pool of generated C++ may pick too. Like there,
+// it works on copies of the variables it uses, so what it sets is gone
+// after it, and it flushes on finishing under FlushPolicy::Block.
+void BytecodeCompiler::spawn(const Node& block) {
+    auto outer_locals = locals_;
+    auto outer_numbers = numbers_;
+
+    std::vector<std::string_view> used;
+    find_used(ast_.children(block), used);
+    for (std::string_view name : used) {
+        auto it = locals_.find(name);
+        // Skip names that are not variables here, or were copied already.
+        if (it == locals_.end() || it->second != outer_locals.at(name)) continue;
+        uint16_t copy = new_register(block);
+        emit(Op::Move, copy, it->second);
+        it->second = copy;
+    }
+
+    for (NodeId id : ast_.children(block)) statement(ast_[id]);
+    flush_pending();
+    if (options_.flush == FlushPolicy::Block) emit_flush();
+
+    locals_ = std::move(outer_locals);
+    numbers_ = std::move(outer_numbers);
+}
+
+void BytecodeCompiler::call(const Node& stmt) {
+    if (is_path(stmt.name)) {
+        // A method is given a copy of every field, in consecutive registers.
+        std::string_view var = path_base(stmt.name);
+        const RecordType& type = *records_.find(stmt.text);
+        std::vector<uint16_t> fields;
+        for (const RecordField& field : type.fields) fields.push_back(variable(std::string(var) + "." + field.name, stmt));
+        uint16_t first = fields[0];
+        for (size_t k = 1; k < fields.size(); ++k) {
+            if (fields[k] != first + k) {
+                first = kNoRegister;
+                break;
+            }
+        }
+        if (first == kNoRegister) {
+            for (size_t k = 0; k < fields.size(); ++k) {
+                uint16_t reg = new_register(stmt);
+                if (k == 0) first = reg;
+                emit(Op::Move, reg, fields[k]);
+            }
+        }
+        flush_pending();
+        emit(Op::Call, first, functions_.at(std::string(stmt.text) + "." + std::string(path_member(stmt.name))));
+        return;
+    }
+
+    auto it = functions_.find(stmt.name);
+    if (it == functions_.end()) fail(stmt, "unknown function '" + std::string(stmt.name) + "'");
+
+    const BytecodeFunction& callee = program_.functions[it->second];
+    ChildRange args = ast_.children(stmt);
+    if (args.size() != callee.params) {
+        fail(stmt, "'" + std::string(stmt.name) + "' takes " + std::to_string(callee.params) +
+            " argument" + (callee.params == 1 ? "" : "s"));
+    }
+
+    uint16_t reg = kNoRegister;
+    if (!args.empty()) {
+        const Node& arg = ast_[args[0]];
+        if (arg.kind == NodeKind::StringLiteral) {
+            reg = hoisted(arg.text, 's');
+            if (reg == kNoRegister) {
+                reg = scratch(arg);
+                emit(Op::LoadStr, reg, constant(arg.text));
+            }
+        }
+        else if (arg.kind == NodeKind::NumberLiteral) {
+            NumType type = literal_type(arg.text);
+            reg = hoisted(arg.text, literal_tag(type));
+            if (reg == kNoRegister) {
+                reg = scratch(arg);
+                load_number(reg, arg.text, type);
+            }
+        }
+        else {
+            reg = variable(arg);
+        }
+    }
+
+    flush_pending();
+    emit(Op::Call, reg, it->second);
+}
+
+void BytecodeCompiler::statement(const Node& stmt) {
+    switch (stmt.kind) {
+    case NodeKind::Say:
+        say(stmt);
+        break;
+    case NodeKind::Flush:
+        pending_line_ = false;
+        flush_pending();
+        emit_flush();
+        break;
+    case NodeKind::Set:
+        set(stmt);
+        break;
+    case NodeKind::Add:
+    case NodeKind::Minus:
+    case NodeKind::Multiply:
+    case NodeKind::Divide:
+        arithmetic(stmt);
+        break;
+    case NodeKind::Repeat:
+        repeat(stmt);
+        break;
+    case NodeKind::ListDef:
+        list(stmt);
+        break;
+    case NodeKind::Pipeline:
+        pipeline(stmt);
+        break;
+    case NodeKind::ForEach:
+        for_each(stmt);
+        break;
+    case NodeKind::Spawn:
+        spawn(stmt);
+        break;
+    case NodeKind::Match:
+        match(stmt);
+        break;
+    case NodeKind::Yield:
+        pending_line_ = false;
+        flush_pending();
+        emit(Op::Sleep, 0, static_cast<uint32_t>(std::strtoul(std::string(stmt.text).c_str(), nullptr, 10)));
+        break;
+    case NodeKind::FunctionCall:
+        call(stmt);
+        break;
+    case NodeKind::FunctionDef:
+    case NodeKind::StartBlock:
+        fail(stmt, "blocks cannot be nested");
+    default:
+        break;
+    }
+}
+
+void BytecodeCompiler::function(uint32_t index, const Node& def, bool is_start) {
+    locals_.clear();
+    numbers_.clear();
+    hidden_.clear();
+    registers_ = 0;
+    scratch_ = kNoRegister;
+    record_lists_.clear();
+    if (def.kind == NodeKind::Method) {
+        for (const RecordField& field : records_.find(def.text)->fields) {
+            std::string_view path = name("self." + field.name);
+            locals_[path] = new_register(def);
+            numbers_[path] = field.type;
+        }
+    }
+    else if (!is_start && !def.text.empty()) {
+        locals_[def.text] = new_register(def);
+    }
+
+    program_.functions[index].entry = static_cast<uint32_t>(program_.code.size());
+    flushed_ = false;
+    for (NodeId id : ast_.children(def)) statement(ast_[id]);
+    flush_pending();
+
+    if (is_start || options_.flush == FlushPolicy::Block) emit_flush();
+    emit(Op::Return);
+    program_.functions[index].registers = static_cast<uint16_t>(registers_);
+}
+
+BytecodeProgram BytecodeCompiler::compile() {
+    // Declare every function first so calls may precede definitions.
+    const Node* start = nullptr;
+    for (NodeId id : ast_.statements) {
+        const Node& stmt = ast_[id];
+        if (stmt.kind == NodeKind::FunctionDef) {
+            auto index = static_cast<uint32_t>(program_.functions.size());
+            if (!functions_.emplace(stmt.name, index).second) {
+                fail(stmt, "function '" + std::string(stmt.name) + "' is defined twice");
+            }
+            program_.functions.push_back({ 0, 0, static_cast<uint16_t>(stmt.text.empty() ? 0 : 1) });
+        }
+        else if (stmt.kind == NodeKind::StartBlock) {
+            if (start) fail(stmt, "more than one start block");
+            start = &stmt;
+        }
+        else if (stmt.kind == NodeKind::TypeDef) {
+            // Methods are functions named "Type.method", taking the fields.
+            const RecordType& type = records_.add(ast_, id);
+            for (const std::string& method : type.methods) {
+                functions_.emplace(name(type.name + "." + method), static_cast<uint32_t>(program_.functions.size()));
+                program_.functions.push_back({ 0, 0, static_cast<uint16_t>(type.fields.size()) });
+            }
+        }
+    }
+    if (!start) throw std::runtime_error("program has no start block");
+
+    for (NodeId id : ast_.statements) {
+        const Node& stmt = ast_[id];
+        if (stmt.kind == NodeKind::FunctionDef) function(functions_[stmt.name], stmt, false);
+        if (stmt.kind != NodeKind::TypeDef) continue;
+        for (NodeId member : ast_.children(stmt)) {
+            const Node& method = ast_[member];
+            if (method.kind != NodeKind::Method) continue;
+            function(functions_.at(std::string(stmt.name) + "." + std::string(method.name)), method, false);
+        }
+    }
+
+    program_.entry = static_cast<uint32_t>(program_.functions.size());
+    program_.functions.push_back({ 0, 0, 0 });
+    function(program_.entry, *start, true);
+
+    return std::move(program_);
+}
+
+} // namespace
+
+BytecodeProgram compile_bytecode(const AST& ast, const CodegenOptions& options) {
+    return BytecodeCompiler(ast, options).compile();
+}
@@ -0,0 +1,149 @@
+// bytecode.hpp - Register bytecode compiled from the AST for hcp --run
+#pragma once
+#include "ast.hpp"
+#include "generator.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Every opcode, in encoding order. The VM builds its dispatch table from the
+// same list, so the two cannot drift apart.
+//
+//   a: register (or kNoRegister),
+//   b: constant, function, register, code index or immediate
+#define HERLANG_OPCODES(X) \
+    X(LoadInt)   /* r[a] = int32(b) */                           \
+    X(LoadStr)   /* r[a] = constants[b] */                       \
+    X(LoadI64)   /* r[a] = int64 stored in constants[b] */       \
+    X(LoadF64)   /* r[a] = double stored in constants[b] */      \
+    X(Move)      /* r[a] = r[b] */                               \
+    X(ToFloat)   /* r[a] = double(r[b]), r[b] an integer */      \
+    X(AddI)      /* r[a] += r[b], integers, wrapping */          \
+    X(SubI)      /* r[a] -= r[b] */                              \
+    X(MulI)      /* r[a] *= r[b] */                              \
+    X(DivI)      /* r[a] /= r[b]; fails if r[b] is 0 */          \
+    X(AddF)      /* r[a] += r[b], doubles */                     \
+    X(SubF)      /* r[a] -= r[b] */                              \
+    X(MulF)      /* r[a] *= r[b] */                              \
+    X(DivF)      /* r[a] /= r[b] */                              \
+    X(Print)     /* write r[a] */                                \
+    X(PrintStr)  /* write constants[b] */                        \
+    X(Flush)     /* hand buffered output to the OS */            \
+    X(Sleep)     /* flush, then pause for b milliseconds */      \
+    X(ListStr)   /* r[a] = list of strings, as u32 constant indices packed in constants[b] */ \
+    X(ListI64)   /* r[a] = list of int64 packed in constants[b] */  \
+    X(ListF64)   /* r[a] = list of double packed in constants[b] */ \
+    X(Pipeline)  /* r[a] = list made by the pipeline described in constants[b] */ \
+    X(Jump)      /* continue at code[b] */                       \
+    X(Loop)      /* if r[a] > 0: r[a] -= 1, continue at code[b] */ \
+    X(Next)      /* r[a] list, r[a+1] index: while elements remain, r[a+2] = next one, continue at code[b] */ \
+    X(Switch)    /* continue at the r[a]-th of the u32 code indices packed in constants[b]; past the end, fall through */ \
+    X(Call)      /* call functions[b], passing r[a], r[a+1], ... as its parameters */ \
+    X(Return)    /* return to the caller; ends the program in the entry function */
+
+enum class Op : uint8_t {
+#define HERLANG_OPCODE_ENUM(name) name,
+    HERLANG_OPCODES(HERLANG_OPCODE_ENUM)
+#undef HERLANG_OPCODE_ENUM
+};
+
+#define HERLANG_OPCODE_COUNT(name) +1
+constexpr int kOpCount = 0 HERLANG_OPCODES(HERLANG_OPCODE_COUNT);
+#undef HERLANG_OPCODE_COUNT
+
+// Fixed-width instructions keep decoding to a single load. Registers are
+// numbered per call frame.
+struct Instr {
+    Op op;
+    uint8_t reserved = 0;
+    uint16_t a = 0;
+    uint32_t b = 0;
+};
+static_assert(sizeof(Instr) == 8, "instructions are 8 bytes");
+
+constexpr uint16_t kNoRegister = 0xFFFF;
+
+// A Pipeline constant is the source list's register as a u32 followed by
+// one PipelineStage per filter_gently or transform_kindly, in order. The
+// VM makes the new list in a single pass, taking each element through
+// every stage.
+enum class StageOp : uint8_t {
+    Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual,   // keep if true
+    Contains, StartsWith, EndsWith,                            // text only
+    Add, Sub, Mul, Div,                                        // replace the element
+    Count,
+};
+
+enum class StageOperand : uint8_t {
+    Register,   // r[index], already of the stage's type
+    Element,    // the element itself
+    Text,       // constants[index]
+};
+
+struct PipelineStage {
+    StageOp op;
+    NumType type;            // what the stage works in; None for text
+    StageOperand operand;
+    uint8_t reserved = 0;
+    uint32_t index = 0;
+};
+static_assert(sizeof(PipelineStage) == 8, "pipeline stages are 8 bytes");
+
+struct BytecodeFunction {
+    uint32_t entry;       // index of the first instruction in code
+    uint16_t registers;   // frame size
+    uint16_t params;      // arriving in r0, r1, ...: 0 or 1 for a function, one per field for a method
+};
+static_assert(sizeof(BytecodeFunction) == 8, "function table entries are 8 bytes");
+
+struct BytecodeConstant {
+    uint32_t offset;      // into the string pool
+    uint32_t size;
+};
+static_assert(sizeof(BytecodeConstant) == 8, "constants are 8 bytes");
+
+// What the VM executes: the tables of a program wherever they live, either
+// in a BytecodeProgram or in place inside a mapped .hbc file.
+struct BytecodeView {
+    const Instr* code = nullptr;
+    uint32_t code_size = 0;
+    const BytecodeFunction* functions = nullptr;
+    uint32_t function_count = 0;
+    const BytecodeConstant* constants = nullptr;
+    uint32_t constant_count = 0;
+    const char* strings = nullptr;
+    uint32_t strings_size = 0;
+    uint32_t entry = 0;   // function run by the VM: the start block
+
+    std::string_view constant(uint32_t index) const {
+        return { strings + constants[index].offset, constants[index].size };
+    }
+};
+
+// A whole program as flat arrays. Strings live back to back in `strings`
+// and constants refer to them by offset, so nothing in a program points
+// into the AST or the source it was compiled from.
+struct BytecodeProgram {
+    std::vector<Instr> code;
+    std::vector<BytecodeFunction> functions;
+    std::vector<BytecodeConstant> constants;
+    std::string strings;
+    uint32_t entry = 0;
+
+    BytecodeView view() const {
+        return { code.data(), static_cast<uint32_t>(code.size()),
+                 functions.data(), static_cast<uint32_t>(functions.size()),
+                 constants.data(), static_cast<uint32_t>(constants.size()),
+                 strings.data(), static_cast<uint32_t>(strings.size()), entry };
+    }
+};
+
+// Lowers a parsed program. Function names are resolved across the whole
+// program, so a function may be called before its definition. Throws
+// std::runtime_error for programs the C++ backend would also reject:
+// unknown functions or variables, wrong argument counts, duplicate
+// definitions and a missing or repeated start block. Numbers must already
+// be typed, and record types checked, by fold_constants. Output is flushed
+// as CodegenOptions::flush asks, exactly where generated C++ flushes.
+BytecodeProgram compile_bytecode(const AST& ast, const CodegenOptions& options = {});
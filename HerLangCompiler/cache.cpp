@@ -0,0 +1,78 @@
+// cache.cpp - On-disk cache of compiler outputs keyed by input content
+#include "cache.hpp"
+#include "hash.hpp"
+#include "version.hpp"
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+std::string CompileCache::key_for(std::string_view source, std::string_view options) {
+    std::string salt = HERLANG_COMPILER_VERSION;
+    salt += '\0';
+    salt.append(options.data(), options.size());
+    return hash_hex(hash64(source, hash64(salt)));
+}
+
+std::string CompileCache::entry_path(const std::string& key, const char* ext) const {
+    return (fs::path(dir_) / key.substr(0, 2) / (key + ext)).string();
+}
+
+// The contents of a side file, or nothing if there is none.
+static void read_side_file(const std::string& path, std::string& text) {
+    std::ifstream in(path, std::ios::binary);
+    if (in) text.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+bool CompileCache::fetch(const std::string& key, const std::string& output, std::string& diagnostics,
+    std::string* facts) const {
+    std::error_code ec;
+    if (!fs::copy_file(entry_path(key, ext_.c_str()), output, fs::copy_options::overwrite_existing, ec) || ec) {
+        return false;
+    }
+
+    read_side_file(entry_path(key, ".log"), diagnostics);
+    if (facts) read_side_file(entry_path(key, ".facts"), *facts);
+    return true;
+}
+
+static std::string temp_name(const std::string& path) {
+    static std::atomic<unsigned> counter{ 0 };
+    return path + ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()))
+        + "." + std::to_string(counter++);
+}
+
+// Publishes `tmp` as `path`, or throws it away if it could not be written.
+static void publish(const std::string& tmp, const std::string& path, bool written) {
+    std::error_code ec;
+    if (written) fs::rename(tmp, path, ec);
+    if (!written || ec) fs::remove(tmp, ec);
+}
+
+static void write_side_file(const std::string& path, std::string_view text) {
+    std::string tmp = temp_name(path);
+    std::ofstream out(tmp, std::ios::binary);
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    out.close();
+    publish(tmp, path, static_cast<bool>(out));
+}
+
+void CompileCache::store(const std::string& key, const std::string& output, std::string_view diagnostics,
+    std::string_view facts) const {
+    std::error_code ec;
+    fs::create_directories(fs::path(dir_) / key.substr(0, 2), ec);
+    if (ec) return;
+
+    // Side files go first: a reader that finds the output must also find
+    // its warnings and facts.
+    if (!diagnostics.empty()) write_side_file(entry_path(key, ".log"), diagnostics);
+    if (!facts.empty()) write_side_file(entry_path(key, ".facts"), facts);
+
+    std::string path = entry_path(key, ext_.c_str());
+    std::string tmp = temp_name(path);
+    bool copied = fs::copy_file(output, tmp, fs::copy_options::overwrite_existing, ec) && !ec;
+    publish(tmp, path, copied);
+}
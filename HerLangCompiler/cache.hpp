@@ -0,0 +1,34 @@
+// cache.hpp - On-disk cache of compiler outputs keyed by input content
+#pragma once
+#include <string>
+#include <string_view>
+
+// Entries live under <dir>/<2 hex>/<16 hex><ext>, where <ext> names the kind
+// of output (".cpp" by default, ".hbc" for bytecode, ".o" for objects),
+// with any diagnostics the compile produced stored next to them as .log so
+// a cache hit can replay the same warnings, and any facts the caller needs
+// about the output without reading it as .facts. Writes go through a
+// temporary file and a rename, so concurrent processes may share one
+// directory.
+class CompileCache {
+public:
+    explicit CompileCache(std::string dir, std::string ext = ".cpp")
+        : dir_(std::move(dir)), ext_(std::move(ext)) {}
+
+    // Key over the source bytes, the compiler version and every option that
+    // affects the generated code.
+    static std::string key_for(std::string_view source, std::string_view options);
+
+    // Copies the cached output for `key` to `output`. Returns false on a miss.
+    bool fetch(const std::string& key, const std::string& output, std::string& diagnostics,
+        std::string* facts = nullptr) const;
+    // Copies a freshly written output file into the cache.
+    void store(const std::string& key, const std::string& output, std::string_view diagnostics,
+        std::string_view facts = {}) const;
+
+private:
+    std::string entry_path(const std::string& key, const char* ext) const;
+
+    std::string dir_;
+    std::string ext_;
+};
@@ -0,0 +1,351 @@
+// driver.cpp - Compiles .herc files, one at a time or on a worker pool
+#include "driver.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "generator.hpp"
+#include "fold.hpp"
+#include "bytecode.hpp"
+#include "hbc.hpp"
+#include "warnings.hpp"
+#include "mapped_file.hpp"
+#include "cache.hpp"
+#include "output_file.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if _DEBUG
+static void dump_tokens(const std::vector<Token>& tokens) {
+    std::cerr << "=== Tokens ===\n";
+    for (const auto& tok : tokens) {
+        std::cerr << "[" << tok.line << "] ";
+        switch (tok.type) {
+        case TokenType::Keyword:        std::cerr << "Keyword    "; break;
+        case TokenType::Identifier:     std::cerr << "Identifier "; break;
+        case TokenType::StringLiteral:  std::cerr << "String     "; break;
+        case TokenType::Number:         std::cerr << "Number     "; break;
+        case TokenType::Newline:        std::cerr << "Newline    "; break;
+        case TokenType::EOFToken:       std::cerr << "EOF        "; break;
+        case TokenType::Symbol:         std::cerr << "Symbol     "; break;
+        }
+        std::cerr << ": " << tok.value << "\n";
+    }
+    std::cerr << "==============\n";
+}
+
+static void dump_ast(const AST& ast) {
+    std::cerr << "=== AST ===\n";
+    for (NodeId id : ast.statements) {
+        const Node& stmt = ast[id];
+        if (stmt.kind == NodeKind::FunctionDef) {
+            std::cerr << "Function: " << stmt.name << "(" << stmt.text << "), body size = " << stmt.count << "\n";
+            for (NodeId inner : ast.children(stmt)) {
+                const Node& say = ast[inner];
+                if (say.kind == NodeKind::Say) {
+                    std::cerr << "  Say: ";
+                    for (NodeId arg : ast.children(say)) {
+                        if (ast[arg].kind == NodeKind::Variable) {
+                            std::cerr << "VAR(" << ast[arg].name << ") ";
+                        }
+                        else {
+                            std::cerr << "\"" << ast[arg].text << "\" ";
+                        }
+                    }
+                    std::cerr << "ending = \"" << say.text << "\"\n";
+                }
+            }
+        }
+        else if (stmt.kind == NodeKind::StartBlock) {
+            std::cerr << "Start block, body size = " << stmt.count << "\n";
+        }
+    }
+    std::cerr << "===========\n";
+}
+#endif
+
+// What a cache entry records about its output: whether it has a start block.
+static constexpr std::string_view kHasStartFact = "start";
+
+const char* output_extension(OutputKind kind) {
+    return kind == OutputKind::Bytecode ? ".hbc" : ".cpp";
+}
+
+// Everything besides the source bytes that changes the generated output,
+// starting with what kind of output it is. Streamed C++ skips the
+// whole-program call graph pass, so it differs.
+static std::string codegen_fingerprint(const CompileOptions& options) {
+    std::string key = options.output == OutputKind::Bytecode ? "emit=hbc" : "emit=cpp";
+    key += std::string(";flush=") + flush_policy_name(options.codegen.flush);
+    if (options.output == OutputKind::Bytecode) key += ";hbc=" + std::to_string(kHbcVersion);
+    else if (options.stream) key += ";stream";
+    if (!options.codegen.parallel_lists) key += ";serial-lists";
+    return key;
+}
+
+// Lexes and parses one top-level block at a time and emits it before
+// reading on, so memory use is bounded by the largest block rather than by
+// the whole program. Block boundaries are found by counting block-opening
+// lines against lines consisting of just 'end'. Record types outlive the
+// block that declares them.
+static void compile_streaming(std::string_view source, IndentationChecker& indent, CppEmitter& emitter,
+    bool& has_start, CompileStats* stats) {
+    Lexer lexer(source, &indent);
+    std::vector<Token> unit;
+    AST ast;
+    RecordTable records;
+    int depth = 0;
+    PassTimer lex_timer(stats, Pass::Lex);
+
+    auto flush_unit = [&]() {
+        if (unit.empty()) return;
+        unit.push_back(lexer.eof());
+        lex_timer.stop();
+
+        ast.clear();
+        Parser parser(unit, ast);
+        while (true) {
+            PassTimer parse_timer(stats, Pass::Parse);
+            if (!parser.parse_next()) break;
+            if (ast[ast.statements.back()].kind == NodeKind::StartBlock) has_start = true;
+            fold_constants(ast, ast.statements.back(), records);
+            parse_timer.stop();
+
+            PassTimer generate_timer(stats, Pass::Generate);
+            emitter.emit(ast, ast.statements.back());
+        }
+
+        if (stats) {
+            stats->tokens += unit.size();
+            stats->nodes += ast.node_count();
+        }
+        unit.clear();
+        lex_timer.start();
+    };
+
+    while (true) {
+        size_t line_start = unit.size();
+        if (!lexer.lex_line(unit)) break;
+        if (unit.size() == line_start) continue; // blank or comment line
+
+        const Token& first = unit[line_start];
+        if (opens_block(first)) {
+            ++depth;
+        }
+        else if (depth > 0 && unit.size() - line_start == 2 &&
+            first.kw == Keyword::End) {
+            --depth;
+        }
+
+        if (depth == 0) flush_unit();
+    }
+    flush_unit();
+}
+
+// Output is written while the code is generated; move the time spent in
+// write system calls from the generate pass to the write pass.
+static void charge_io(CompileStats* stats, const OutputFile& file, double generate_io_wall, double generate_io_cpu) {
+    if (!stats) return;
+    stats->add(Pass::Generate, -generate_io_wall, -generate_io_cpu);
+    stats->add(Pass::Write, file.io_wall(), file.io_cpu());
+    stats->bytes_out += file.bytes_written();
+}
+
+CompileResult compile_file(const CompileJob& job, const CompileOptions& options) {
+    CompileResult result;
+    std::ostringstream diag;
+    CompileStats* stats = options.time_passes ? &result.stats : nullptr;
+    if (stats) stats->files = 1;
+
+    try {
+        PassTimer read_timer(stats, Pass::Read);
+        MappedFile input;
+        if (!input.open(job.input)) {
+            diag << "Cannot open input file: " << job.input << "\n";
+            result.diagnostics = diag.str();
+            return result;
+        }
+        std::string_view source = input.view();
+        if (stats) stats->bytes_in = source.size();
+
+        std::string cache_key;
+        if (!options.cache_dir.empty()) {
+            CompileCache cache(options.cache_dir, output_extension(options.output));
+            cache_key = CompileCache::key_for(source, codegen_fingerprint(options));
+            std::string facts;
+            if (cache.fetch(cache_key, job.output, result.diagnostics, &facts)) {
+                result.ok = true;
+                result.has_start = facts == kHasStartFact;
+                result.cache_hit = true;
+                if (stats) stats->cache_hits = 1;
+                return result;
+            }
+        }
+        read_timer.stop();
+
+        // Indentation warnings are produced by the lexer as it goes.
+        IndentationChecker indent(diag);
+
+        // In streaming mode the output is opened up front and written while
+        // parsing; otherwise only once the whole program has parsed.
+        OutputFile file;
+        file.set_timing(stats != nullptr);
+        auto open_output = [&]() {
+            PassTimer timer(stats, Pass::Write);
+            if (!file.open(job.output)) {
+                throw std::runtime_error("Cannot write to output file: " + job.output);
+            }
+        };
+
+        try {
+            // Bytecode resolves calls across the whole program, so it is
+            // never streamed.
+            if (options.stream && options.output == OutputKind::Cpp) {
+                open_output();
+                std::ostream out(&file);
+                CppEmitter emitter(out, options.codegen);
+                emitter.begin();
+                compile_streaming(source, indent, emitter, result.has_start, stats);
+                PassTimer generate_timer(stats, Pass::Generate);
+                emitter.finish();
+                out.flush();
+            }
+            else {
+                PassTimer lex_timer(stats, Pass::Lex);
+                auto tokens = lex(source, &indent);
+                lex_timer.stop();
+#if _DEBUG
+                dump_tokens(tokens);
+#endif
+                PassTimer parse_timer(stats, Pass::Parse);
+                auto ast = parse(tokens);
+                fold_constants(ast);
+                parse_timer.stop();
+                result.has_start = std::any_of(ast.statements.begin(), ast.statements.end(),
+                    [&](NodeId id) { return ast[id].kind == NodeKind::StartBlock; });
+#if _DEBUG
+                dump_ast(ast);
+#endif
+                if (stats) {
+                    stats->tokens = tokens.size();
+                    stats->nodes = ast.node_count();
+                }
+
+                open_output();
+                PassTimer generate_timer(stats, Pass::Generate);
+                std::ostream out(&file);
+                if (options.output == OutputKind::Bytecode) {
+                    write_hbc(compile_bytecode(ast, options.codegen), out);
+                }
+                else {
+                    generate_cpp(ast, out, options.codegen);
+                }
+                out.flush();
+            }
+
+            double generate_io_wall = file.io_wall();
+            double generate_io_cpu = file.io_cpu();
+            bool closed = file.close();
+            charge_io(stats, file, generate_io_wall, generate_io_cpu);
+            if (!closed) {
+                throw std::runtime_error("Cannot write to output file: " + job.output);
+            }
+        }
+        catch (...) {
+            if (file.is_open()) {
+                file.close();
+                std::error_code ec;
+                std::filesystem::remove(job.output, ec);
+            }
+            throw;
+        }
+
+        result.ok = true;
+        if (!cache_key.empty()) {
+            CompileCache(options.cache_dir, output_extension(options.output))
+                .store(cache_key, job.output, diag.str(), result.has_start ? kHasStartFact : "");
+        }
+    }
+    catch (const std::exception& e) {
+        diag << "[Error] " << job.input << ": " << e.what() << "\n";
+    }
+
+    result.diagnostics = diag.str();
+    return result;
+}
+
+CompileResult compile_to_bytecode(const std::string& input, BytecodeProgram& program,
+    const CompileOptions& options) {
+    CompileResult result;
+    std::ostringstream diag;
+    CompileStats* stats = options.time_passes ? &result.stats : nullptr;
+    if (stats) stats->files = 1;
+
+    try {
+        PassTimer read_timer(stats, Pass::Read);
+        MappedFile file;
+        if (!file.open(input)) {
+            diag << "Cannot open input file: " << input << "\n";
+            result.diagnostics = diag.str();
+            return result;
+        }
+        std::string_view source = file.view();
+        if (stats) stats->bytes_in = source.size();
+        read_timer.stop();
+
+        IndentationChecker indent(diag);
+        PassTimer lex_timer(stats, Pass::Lex);
+        auto tokens = lex(source, &indent);
+        lex_timer.stop();
+
+        PassTimer parse_timer(stats, Pass::Parse);
+        auto ast = parse(tokens);
+        fold_constants(ast);
+        parse_timer.stop();
+        if (stats) {
+            stats->tokens = tokens.size();
+            stats->nodes = ast.node_count();
+        }
+
+        PassTimer generate_timer(stats, Pass::Generate);
+        program = compile_bytecode(ast, options.codegen);
+        result.ok = true;
+    }
+    catch (const std::exception& e) {
+        diag << "[Error] " << input << ": " << e.what() << "\n";
+    }
+
+    result.diagnostics = diag.str();
+    return result;
+}
+
+std::vector<CompileResult> compile_all(const std::vector<CompileJob>& jobs, unsigned threads,
+    const CompileOptions& options) {
+    std::vector<CompileResult> results(jobs.size());
+    std::atomic<size_t> next{ 0 };
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < jobs.size(); i = next++) {
+            results[i] = compile_file(jobs[i], options);
+        }
+    };
+
+    size_t count = std::min<size_t>(std::max(threads, 1u), jobs.size());
+    if (count <= 1) {
+        worker();
+        return results;
+    }
+
+    std::vector<std::thread> pool;
+    pool.reserve(count - 1);
+    for (size_t t = 1; t < count; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& th : pool) th.join();
+
+    return results;
+}
@@ -0,0 +1,50 @@
+// driver.hpp - Compiles .herc files, one at a time or on a worker pool
+#pragma once
+#include "bytecode.hpp"
+#include "generator.hpp"
+#include "stats.hpp"
+#include <string>
+#include <vector>
+
+struct CompileJob {
+    std::string input;
+    std::string output;
+};
+
+enum class OutputKind {
+    Cpp,        // C++ source for a native toolchain
+    Bytecode,   // an .hbc file for hcp --run
+};
+
+// ".cpp" or ".hbc", for output files and their cache entries.
+const char* output_extension(OutputKind kind);
+
+struct CompileOptions {
+    std::string cache_dir;     // empty: no incremental cache
+    bool stream = false;       // emit each top-level block as soon as it is parsed (C++ only)
+    bool time_passes = false;  // fill CompileResult::stats
+    OutputKind output = OutputKind::Cpp;
+    CodegenOptions codegen;
+};
+
+struct CompileResult {
+    bool ok = false;
+    bool cache_hit = false;
+    bool has_start = false;    // the program has a start block, so its C++ defines main()
+    std::string diagnostics;   // warnings and errors, in the order they were produced
+    CompileStats stats;        // only with CompileOptions::time_passes
+};
+
+// Runs the whole pipeline for one file. Never throws: lexer and parser
+// errors are reported through the result.
+CompileResult compile_file(const CompileJob& job, const CompileOptions& options = {});
+
+// Compiles every job on up to `threads` workers. Results are returned in
+// job order regardless of which worker finished first.
+std::vector<CompileResult> compile_all(const std::vector<CompileJob>& jobs, unsigned threads,
+    const CompileOptions& options = {});
+
+// Front end plus bytecode lowering for hcp --run: fills `program` instead of
+// writing C++. Never throws; the cache and streaming options do not apply.
+CompileResult compile_to_bytecode(const std::string& input, BytecodeProgram& program,
+    const CompileOptions& options = {});
@@ -0,0 +1,960 @@
+// fold.cpp - Numeric typing and constant folding over the AST
+#include "fold.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+std::string format_number(NumType type, int64_t i, double f) {
+    char text[32];
+    if (type == NumType::Float) {
+        int n = std::snprintf(text, sizeof text, "%g", f);
+        return std::string(text, n > 0 ? static_cast<size_t>(n) : 0);
+    }
+    auto r = std::to_chars(text, text + sizeof text, i);
+    return std::string(text, r.ptr);
+}
+
+namespace {
+
+struct Number {
+    NumType type = NumType::Int;
+    int64_t i = 0;
+    double f = 0;
+
+    double as_float() const { return type == NumType::Float ? f : static_cast<double>(i); }
+};
+
+bool is_arithmetic(NodeKind kind) {
+    return kind == NodeKind::Add || kind == NodeKind::Minus ||
+        kind == NodeKind::Multiply || kind == NodeKind::Divide;
+}
+
+// The lexer only produces "1.5"; folding may also respell a double "1e+20".
+bool is_float_literal(std::string_view text) {
+    return text.find_first_of(".e") != std::string_view::npos;
+}
+
+// Unrolling stops where a loop would stand for more statements than this.
+constexpr size_t kMaxUnrolledStatements = 32;
+
+class Folder {
+public:
+    Folder(AST& ast, NodeId block, const RecordTable& records) : ast_(ast), block_(block), records_(records) {
+        const Node& node = ast[block];
+        if (node.kind == NodeKind::FunctionDef) param_ = node.text;
+        if (node.kind == NodeKind::Method) {
+            // A method works on its own copy of the record, whose number
+            // fields it may calculate with and change.
+            param_ = "self";
+            self_ = records.find(node.text);
+            for (const RecordField& field : self_->fields) {
+                if (field.type == NumType::None) continue;
+                std::string_view path = ast.intern("self." + field.name);
+                declared_.insert(path);
+                types_[path] = field.type;
+            }
+        }
+    }
+
+    void run() {
+        check_and_type();
+        fold_block(block_);
+        std::unordered_set<std::string_view> live;
+        find_live(ast_.children(block_), live);
+        drop_dead_sets(block_, live);
+    }
+
+private:
+    [[noreturn]] void fail(const Node& node, const std::string& message) const {
+        throw std::runtime_error("line " + std::to_string(node.line) + ": " + message);
+    }
+
+    NodeId operand_id(const Node& stmt) const { return ast_.children(stmt)[0]; }
+
+    Number parse_literal(const Node& literal) const {
+        Number n;
+        std::string_view text = literal.text;
+        if (is_float_literal(text)) {
+            n.type = NumType::Float;
+            n.f = std::strtod(std::string(text).c_str(), nullptr);
+            return n;
+        }
+        auto r = std::from_chars(text.data(), text.data() + text.size(), n.i);
+        if (r.ec != std::errc()) fail(literal, "number " + std::string(text) + " is too large");
+        return n;
+    }
+
+    // Only variables created by `set` earlier in this block can take part in
+    // arithmetic; a parameter may hold a string.
+    void require_number(const Node& at, std::string_view name) const {
+        if (declared_.count(name)) return;
+        if (is_path(name)) {
+            fail(at, "'" + std::string(name) + "' is a text field; only Number and Float fields can be calculated with");
+        }
+        if (name == param_) {
+            fail(at, "'" + std::string(name) + "' is a parameter; set a number first to calculate with it");
+        }
+        fail(at, "'" + std::string(name) + "' is not a number set earlier in this block");
+    }
+
+    // The count variable of a Repeat, as an operand node.
+    static Node variable_node(const Node& loop) {
+        Node var;
+        var.kind = NodeKind::Variable;
+        var.line = loop.line;
+        var.name = loop.name;
+        return var;
+    }
+
+    void require_fresh(const Node& at, std::string_view name) const;
+    const RecordType* record_of(std::string_view name) const;
+    void note_bound(NodeId at, std::string_view name);
+    NumType bound_type(NodeId at, std::string_view name);
+    void check_path(const Node& at, std::string_view path) const;
+    void check_operand(const Node& at, const Node& operand) const;
+    void check_field_target(const Node& stmt) const;
+    void check_method_call(Node& call);
+    const RecordType* record_type(Node& list) const;
+    void check_match(Node& match);
+    void check(ChildRange body, bool top);
+    void check_stage(const Node& stage, std::string_view list, bool text) const;
+    NumType list_type(const Node& list) const;
+    NumType operand_type(const Node& stage);
+    bool type_pipeline(NodeId id);
+    void check_and_type();
+    bool value_of(const Node& operand, Number& out) const;
+    void fold_block(NodeId block);
+    void fold_statement(NodeId id, std::vector<NodeId>& out);
+    void fold_repeat(NodeId id, std::vector<NodeId>& out);
+    void fold_stage(const Node& stage);
+    void forget_assigned(ChildRange body);
+    size_t unrolled_size(ChildRange body) const;
+    NodeId clone(NodeId id);
+    void find_live(ChildRange body, std::unordered_set<std::string_view>& live) const;
+    void drop_dead_sets(NodeId block, const std::unordered_set<std::string_view>& live);
+    void respell(Node& literal, const Number& value);
+
+    AST& ast_;
+    NodeId block_;
+    const RecordTable& records_;
+    std::string_view param_;
+    const RecordType* self_ = nullptr;   // in a method
+    std::unordered_set<std::string_view> declared_;
+    std::unordered_map<std::string_view, NumType> types_;
+    std::unordered_map<std::string_view, Number> known_;
+    std::vector<NodeId> numeric_;   // Set and arithmetic nodes
+    std::vector<NodeId> loops_;
+    std::vector<NodeId> pipelines_;
+    std::unordered_map<std::string_view, NumType> lists_;   // element types
+    std::unordered_map<std::string_view, const RecordType*> record_lists_;
+    // The variables of the loops and match arms being checked; each lives
+    // only in its body, so sibling loops may reuse a name.
+    struct LoopVar {
+        NumType type;
+        const RecordType* record;   // for a loop over a list of records
+        std::string_view list;      // for a loop over numbers, whose type it follows
+    };
+    std::unordered_map<std::string_view, LoopVar> loop_vars_;
+    // Where a loop variable is calculated with, what it stands for there:
+    // the same name may be another loop's, with another type, elsewhere.
+    struct Bound {
+        NumType type;
+        std::string_view list;
+    };
+    std::unordered_map<NodeId, Bound> bound_;
+    bool spawned_ = false;   // checking the body of a spawn_gently
+};
+
+// A new list or loop variable must not share its name with anything else
+// in the block.
+void Folder::require_fresh(const Node& at, std::string_view name) const {
+    if (name == param_ || declared_.count(name) || lists_.count(name) || loop_vars_.count(name)) {
+        fail(at, "'" + std::string(name) + "' is already used in this block");
+    }
+}
+
+// The record a variable holds in this block: `self` in a method, or the
+// variable of a loop over a list of records that is running.
+const RecordType* Folder::record_of(std::string_view name) const {
+    if (self_ && name == param_) return self_;
+    auto it = loop_vars_.find(name);
+    return it != loop_vars_.end() ? it->second.record : nullptr;
+}
+
+// Notes which loop a number `at` calculates with belongs to, if any.
+void Folder::note_bound(NodeId at, std::string_view name) {
+    auto it = loop_vars_.find(is_path(name) ? path_base(name) : name);
+    if (it == loop_vars_.end()) return;
+    if (is_path(name)) {
+        const RecordType& record = *it->second.record;
+        bound_[at] = { record.fields[record.field(path_member(name))].type, {} };
+    }
+    else {
+        bound_[at] = { it->second.type, it->second.list };
+    }
+}
+
+// The type of the number `at` calculates with by name.
+NumType Folder::bound_type(NodeId at, std::string_view name) {
+    auto it = bound_.find(at);
+    if (it == bound_.end()) return types_[name];
+    return it->second.list.empty() ? it->second.type : lists_[it->second.list];
+}
+
+void Folder::check_path(const Node& at, std::string_view path) const {
+    std::string_view base = path_base(path);
+    const RecordType* type = record_of(base);
+    if (!type) fail(at, "'" + std::string(base) + "' is not a record");
+    if (type->field(path_member(path)) < 0) {
+        fail(at, type->name + " has no field '" + std::string(path_member(path)) + "'");
+    }
+}
+
+// A value said, passed or calculated with: a record is used one field at
+// a time.
+void Folder::check_operand(const Node& at, const Node& operand) const {
+    if (operand.kind != NodeKind::Variable) return;
+    if (is_path(operand.name)) {
+        check_path(at, operand.name);
+    }
+    else if (const RecordType* type = record_of(operand.name)) {
+        if (type->has_cases()) {
+            fail(at, "'" + std::string(operand.name) + "' is a " + type->name + "; use match_gently to reach what it holds");
+        }
+        fail(at, "'" + std::string(operand.name) + "' is a " + type->name + "; use one of its fields, such as " +
+            std::string(operand.name) + "." + type->fields[0].name);
+    }
+}
+
+// Records in a list never change; a method changes its own copy.
+void Folder::check_field_target(const Node& stmt) const {
+    check_path(stmt, stmt.name);
+    std::string_view base = path_base(stmt.name);
+    if (base != param_) {
+        fail(stmt, "cannot change '" + std::string(stmt.name) + "'; the loop variable '" + std::string(base) +
+            "' cannot be changed");
+    }
+    if (self_->fields[self_->field(path_member(stmt.name))].type == NumType::None) {
+        fail(stmt, "'" + std::string(stmt.name) + "' is text; only Number and Float fields can be changed");
+    }
+}
+
+// p.greet: the backends find the method through the type, recorded in the
+// call's text.
+void Folder::check_method_call(Node& call) {
+    std::string_view base = path_base(call.name);
+    const RecordType* type = record_of(base);
+    if (!type) fail(call, "'" + std::string(base) + "' is not a record");
+    if (!type->has_method(path_member(call.name))) {
+        fail(call, type->name + " has no method '" + std::string(path_member(call.name)) + "'");
+    }
+    if (call.count) fail(call, "methods take no arguments");
+    call.text = ast_.intern(type->name);
+}
+
+void Folder::check(ChildRange body, bool top) {
+    for (NodeId id : body) {
+        Node& stmt = ast_[id];
+        if (stmt.kind == NodeKind::Say || stmt.kind == NodeKind::FunctionCall) {
+            if (stmt.kind == NodeKind::FunctionCall && is_path(stmt.name)) check_method_call(stmt);
+            for (NodeId arg : ast_.children(stmt)) {
+                const Node& operand = ast_[arg];
+                if (operand.kind == NodeKind::Variable && lists_.count(operand.name)) {
+                    fail(stmt, "list '" + std::string(operand.name) + "' can only be used by 'for each'");
+                }
+                check_operand(stmt, operand);
+            }
+        }
+        else if (stmt.kind == NodeKind::Set) {
+            if (is_path(stmt.name)) {
+                check_field_target(stmt);
+            }
+            else {
+                if (stmt.name == param_) fail(stmt, "cannot set the parameter '" + std::string(stmt.name) + "'");
+                if (loop_vars_.count(stmt.name) || lists_.count(stmt.name)) {
+                    fail(stmt, "'" + std::string(stmt.name) + "' is already used in this block");
+                }
+            }
+            if (stmt.count && ast_[operand_id(stmt)].kind == NodeKind::Variable) {
+                check_operand(stmt, ast_[operand_id(stmt)]);
+                require_number(stmt, ast_[operand_id(stmt)].name);
+                note_bound(operand_id(stmt), ast_[operand_id(stmt)].name);
+            }
+            declared_.insert(stmt.name);
+            types_.emplace(stmt.name, NumType::Int);
+            numeric_.push_back(id);
+        }
+        else if (is_arithmetic(stmt.kind)) {
+            if (is_path(stmt.name)) check_field_target(stmt);
+            else if (loop_vars_.count(stmt.name)) fail(stmt, "cannot change the loop variable '" + std::string(stmt.name) + "'");
+            require_number(stmt, stmt.name);
+            if (ast_[operand_id(stmt)].kind == NodeKind::Variable) {
+                check_operand(stmt, ast_[operand_id(stmt)]);
+                require_number(stmt, ast_[operand_id(stmt)].name);
+                note_bound(operand_id(stmt), ast_[operand_id(stmt)].name);
+            }
+            numeric_.push_back(id);
+        }
+        else if (stmt.kind == NodeKind::Repeat) {
+            if (is_path(stmt.name)) check_path(stmt, stmt.name);
+            if (!stmt.name.empty()) {
+                require_number(stmt, stmt.name);
+                note_bound(id, stmt.name);
+            }
+            else if (is_float_literal(stmt.text)) fail(stmt, "repeat count must be a whole number");
+            loops_.push_back(id);
+            check(ast_.children(stmt), false);
+        }
+        else if (stmt.kind == NodeKind::Pipeline) {
+            if (!top) fail(stmt, "lists can only be made at the top of a function or start block");
+            require_fresh(stmt, stmt.name);
+            auto source = lists_.find(stmt.text);
+            if (source == lists_.end()) fail(stmt, "'" + std::string(stmt.text) + "' is not a list made earlier in this block");
+            if (record_lists_.count(stmt.text)) {
+                fail(stmt, "'" + std::string(stmt.text) + "' holds records; filter_gently and transform_kindly work on text and numbers");
+            }
+            for (NodeId stage : ast_.children(stmt)) check_stage(ast_[stage], stmt.text, source->second == NumType::None);
+            pipelines_.push_back(id);
+            type_pipeline(id);
+        }
+        else if (stmt.kind == NodeKind::ListDef) {
+            // Lists live as long as the whole block, so they are made at its top.
+            if (!top) fail(stmt, "lists can only be made at the top of a function or start block");
+            require_fresh(stmt, stmt.name);
+            const RecordType* record = record_type(stmt);
+            stmt.type = record ? NumType::None : list_type(stmt);
+            lists_.emplace(stmt.name, stmt.type);
+            if (record) record_lists_.emplace(stmt.name, record);
+        }
+        else if (stmt.kind == NodeKind::ForEach) {
+            auto list = lists_.find(stmt.text);
+            if (list == lists_.end()) fail(stmt, "'" + std::string(stmt.text) + "' is not a list made earlier in this block");
+            stmt.type = list->second;
+            auto records = record_lists_.find(stmt.text);
+            const RecordType* record = records != record_lists_.end() ? records->second : nullptr;
+
+            require_fresh(stmt, stmt.name);
+            loop_vars_[stmt.name] = { stmt.type, record, record ? std::string_view() : stmt.text };
+            loops_.push_back(id);
+
+            // A number element, or a number field of a record, can be
+            // calculated with inside the body.
+            std::vector<std::string_view> numbers;
+            if (stmt.type != NumType::None) numbers.push_back(stmt.name);
+            if (record) {
+                for (const RecordField& field : record->fields) {
+                    if (field.type == NumType::None) continue;
+                    numbers.push_back(ast_.intern(std::string(stmt.name) + "." + field.name));
+                }
+            }
+            for (std::string_view name : numbers) declared_.insert(name);
+            check(ast_.children(stmt), false);
+            for (std::string_view name : numbers) declared_.erase(name);
+            loop_vars_.erase(stmt.name);
+        }
+        else if (stmt.kind == NodeKind::Spawn) {
+            // A spawned block works on copies, so what it sets stays its own.
+            auto outer = declared_;
+            bool spawned = spawned_;
+            spawned_ = true;
+            check(ast_.children(stmt), false);
+            spawned_ = spawned;
+            declared_ = std::move(outer);
+        }
+        else if (stmt.kind == NodeKind::AwaitAll) {
+            // It would wait for the very block it is in.
+            if (spawned_) fail(stmt, "await_all_with_patience cannot be used inside spawn_gently");
+        }
+        else if (stmt.kind == NodeKind::Match) {
+            check_match(stmt);
+        }
+        else if (stmt.kind == NodeKind::TypeDef) {
+            fail(stmt, "types can only be defined outside functions and the start block");
+        }
+    }
+}
+
+// Every case is handled, by its own arm or by a last `case _`. The names
+// an arm binds are like loop variables of its body: they cannot be
+// changed, and number fields can be calculated with. The backends find
+// the type through the match's text.
+void Folder::check_match(Node& match) {
+    const RecordType* type = record_of(match.name);
+    if (!type || !type->has_cases()) {
+        fail(match, "'" + std::string(match.name) + "' is not a value of a gentle_type with cases");
+    }
+    match.text = ast_.intern(type->name);
+
+    std::vector<bool> handled(type->cases.size(), false);
+    bool others = false;
+    for (NodeId id : ast_.children(match)) {
+        const Node& arm = ast_[id];
+        if (others) fail(arm, "'case _' must be the last case");
+        if (arm.name == "_") {
+            others = true;
+            check(ast_.children(arm), false);
+            continue;
+        }
+
+        int index = type->find_case(arm.name);
+        if (index < 0) fail(arm, type->name + " has no case '" + std::string(arm.name) + "'");
+        if (handled[index]) fail(arm, "case " + std::string(arm.name) + " is handled twice");
+        handled[index] = true;
+
+        const RecordCase& value = type->cases[index];
+        std::vector<std::string_view> names = arm_bindings(arm.text);
+        if (!names.empty() && names.size() != value.fields.size()) {
+            fail(arm, value.name + " has " + std::to_string(value.fields.size()) + " fields, but " +
+                std::to_string(names.size()) + " names are given");
+        }
+        std::vector<std::string_view> bound;
+        for (size_t k = 0; k < names.size(); ++k) {
+            std::string_view name = names[k];
+            NumType field_type = value.fields[k].type;
+            if (name == "_") continue;
+            require_fresh(arm, name);
+            loop_vars_[name] = { field_type, nullptr, {} };
+            if (field_type != NumType::None) declared_.insert(name);
+            bound.push_back(name);
+        }
+        check(ast_.children(arm), false);
+        for (std::string_view name : bound) {
+            declared_.erase(name);
+            loop_vars_.erase(name);
+        }
+    }
+
+    for (size_t k = 0; k < handled.size() && !others; ++k) {
+        if (!handled[k]) {
+            fail(match, "match_gently " + std::string(match.name) + " does not handle case " + type->cases[k].name +
+                "; add it or 'case _'");
+        }
+    }
+}
+
+// A stage works either on text, comparing it with a literal, or on numbers,
+// with literals and the numbers set earlier in the block. Its element
+// variable is local to it but may not hide anything else.
+void Folder::check_stage(const Node& stage, std::string_view list, bool text) const {
+    if (stage.name == param_ || declared_.count(stage.name) || lists_.count(stage.name)) {
+        fail(stage, "'" + std::string(stage.name) + "' is already used in this block");
+    }
+
+    const Node& operand = ast_[operand_id(stage)];
+    bool text_test = stage.text == "contains" || stage.text == "starts_with" || stage.text == "ends_with";
+    if (text) {
+        if (stage.kind == NodeKind::Transform) {
+            fail(stage, "transform_kindly calculates with numbers, but '" + std::string(list) + "' holds text");
+        }
+        if (!text_test && stage.text != "==" && stage.text != "!=") {
+            fail(stage, "text can only be compared with == and !=");
+        }
+        if (operand.kind != NodeKind::StringLiteral) fail(stage, "text can only be compared with text in quotes");
+        return;
+    }
+
+    if (text_test) fail(stage, "'" + std::string(stage.text) + "' only works on text");
+    if (operand.kind == NodeKind::StringLiteral) fail(stage, "numbers cannot be compared or calculated with text");
+    if (operand.kind == NodeKind::Variable && operand.name != stage.name) require_number(stage, operand.name);
+}
+
+// The type of a list of records, checking every record against it, or
+// nullptr for a list of text or numbers.
+const RecordType* Folder::record_type(Node& list) const {
+    ChildRange items = ast_.children(list);
+    if (items.empty() || ast_[items[0]].kind != NodeKind::RecordLiteral) return nullptr;
+
+    // A type with cases is written as its cases: Success("ok").
+    std::string_view name = ast_[items[0]].name;
+    const RecordType* type = records_.find(name);
+    if (type && type->has_cases()) {
+        fail(list, type->name + " has cases; write one of them, such as " + type->cases[0].name + "(...)");
+    }
+    if (!type) type = records_.of_case(name);
+    if (!type) fail(list, "unknown type '" + std::string(name) + "'; a gentle_type has to be defined before it is used");
+    for (NodeId id : items) {
+        const Node& record = ast_[id];
+        if (record.kind != NodeKind::RecordLiteral ||
+            (type->has_cases() ? records_.of_case(record.name) != type : record.name != name)) {
+            fail(list, "a list holds text, numbers or records of one type, not a mix");
+        }
+        const std::vector<RecordField>& fields = type->has_cases()
+            ? type->cases[type->find_case(record.name)].fields : type->fields;
+        std::string owner(record.name);
+        if (record.count != fields.size()) {
+            fail(record, owner + " has " + std::to_string(fields.size()) + " fields, but " +
+                std::to_string(record.count) + " values are given");
+        }
+        ChildRange values = ast_.children(record);
+        for (size_t k = 0; k < values.size(); ++k) {
+            const Node& value = ast_[values[k]];
+            const RecordField& field = fields[k];
+            if (field.type == NumType::None) {
+                if (value.kind != NodeKind::StringLiteral) fail(record, "field '" + field.name + "' of " + owner + " is text");
+            }
+            else if (value.kind != NodeKind::NumberLiteral) {
+                fail(record, "field '" + field.name + "' of " + owner + " is a number");
+            }
+            else if (parse_literal(value).type == NumType::Float && field.type == NumType::Int) {
+                fail(record, "field '" + field.name + "' of " + owner + " is a whole Number");
+            }
+        }
+    }
+    list.text = ast_.intern(type->name);
+    return type;
+}
+
+// Text if every element is a string; Float if any number has a fraction.
+NumType Folder::list_type(const Node& list) const {
+    ChildRange items = ast_.children(list);
+    if (items.empty() || ast_[items[0]].kind == NodeKind::StringLiteral) {
+        for (NodeId id : items) {
+            if (ast_[id].kind != NodeKind::StringLiteral) fail(list, "a list holds text, numbers or records of one type, not a mix");
+        }
+        return NumType::None;
+    }
+
+    NumType type = NumType::Int;
+    for (NodeId id : items) {
+        const Node& item = ast_[id];
+        if (item.kind != NodeKind::NumberLiteral) fail(list, "a list holds text, numbers or records of one type, not a mix");
+        if (parse_literal(item).type == NumType::Float) type = NumType::Float;
+    }
+    return type;
+}
+
+// The type of what a stage compares or calculates with.
+NumType Folder::operand_type(const Node& stage) {
+    const Node& operand = ast_[operand_id(stage)];
+    if (operand.kind == NodeKind::StringLiteral) return NumType::None;
+    if (operand.kind == NodeKind::NumberLiteral) return is_float_literal(operand.text) ? NumType::Float : NumType::Int;
+    if (operand.name == stage.name) return stage.type;
+    return types_[operand.name];
+}
+
+// Types each stage of a pipeline from its source's element type: a
+// calculation with a double makes doubles. Returns true if the type of
+// the list it makes changed.
+bool Folder::type_pipeline(NodeId id) {
+    Node& pipeline = ast_[id];
+    NumType type = lists_[pipeline.text];
+    for (NodeId stage_id : ast_.children(pipeline)) {
+        Node& stage = ast_[stage_id];
+        stage.type = type;
+        if (stage.kind == NodeKind::Transform && operand_type(stage) == NumType::Float) type = NumType::Float;
+    }
+    pipeline.type = type;
+
+    NumType& made = lists_[pipeline.name];
+    if (made == type) return false;
+    made = type;
+    return true;
+}
+
+void Folder::check_and_type() {
+    check(ast_.children(block_), true);
+
+    // A variable is Float as soon as anything assigned to it is; `set y = x`
+    // makes y follow x, so repeat until nothing changes. Lists made by a
+    // pipeline and the loop variables walking them follow the same way.
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (NodeId id : pipelines_) {
+            if (type_pipeline(id)) changed = true;
+        }
+        for (NodeId id : numeric_) {
+            const Node& stmt = ast_[id];
+            if (!stmt.count || types_[stmt.name] == NumType::Float) continue;
+
+            const Node& value = ast_[operand_id(stmt)];
+            bool is_float = value.kind == NodeKind::NumberLiteral ? is_float_literal(value.text)
+                : bound_type(operand_id(stmt), value.name) == NumType::Float;
+            if (is_float) {
+                types_[stmt.name] = NumType::Float;
+                changed = true;
+            }
+        }
+    }
+
+    for (NodeId id : numeric_) {
+        Node& stmt = ast_[id];
+        stmt.type = types_[stmt.name];
+        // A field keeps the type its gentle_type gives it.
+        if (is_path(stmt.name) && stmt.type != self_->fields[self_->field(path_member(stmt.name))].type) {
+            fail(stmt, "'" + std::string(stmt.name) + "' is a whole Number and cannot be given a fraction");
+        }
+    }
+    for (NodeId id : loops_) {
+        Node& loop = ast_[id];
+        if (loop.kind == NodeKind::ForEach) {
+            loop.type = lists_[loop.text];
+        }
+        else if (!loop.name.empty() && bound_type(id, loop.name) == NumType::Float) {
+            fail(loop, "repeat count '" + std::string(loop.name) + "' must be a whole number");
+        }
+    }
+}
+
+// Spells a literal the way both backends expect: integers in plain
+// decimal, doubles with enough digits to read back exactly.
+void Folder::respell(Node& literal, const Number& value) {
+    std::string text;
+    if (value.type == NumType::Float) {
+        char buf[40];
+        for (int precision = 15; precision <= 17; ++precision) {
+            std::snprintf(buf, sizeof buf, "%.*g", precision, value.f);
+            if (std::strtod(buf, nullptr) == value.f) break;
+        }
+        text = buf;
+        if (text.find_first_of(".e") == std::string::npos) text += ".0";
+    }
+    else {
+        text = format_number(NumType::Int, value.i, 0);
+    }
+    literal.kind = NodeKind::NumberLiteral;
+    literal.text = ast_.intern(text);
+}
+
+bool Folder::value_of(const Node& operand, Number& out) const {
+    if (operand.kind == NodeKind::NumberLiteral) {
+        out = parse_literal(operand);
+        return true;
+    }
+    if (operand.kind != NodeKind::Variable) return false;
+    auto it = known_.find(operand.name);
+    if (it == known_.end()) return false;
+    out = it->second;
+    return true;
+}
+
+// Folds the statements of `block` in order and, when loops were unrolled,
+// gives it the new statement list.
+void Folder::fold_block(NodeId block) {
+    ChildRange children = ast_.children(block);
+    std::vector<NodeId> body(children.begin(), children.end());
+    std::vector<NodeId> folded;
+    folded.reserve(body.size());
+    for (NodeId id : body) fold_statement(id, folded);
+    if (folded == body) return;
+
+    size_t mark = ast_.open_list();
+    for (NodeId id : folded) ast_.push_child(id);
+    ast_.close_list(block, mark);
+}
+
+// Every statement in a block runs once per pass through it, in order, so a
+// variable's value after a statement is known whenever its inputs were.
+void Folder::fold_statement(NodeId id, std::vector<NodeId>& out) {
+    if (ast_[id].kind == NodeKind::Repeat) {
+        fold_repeat(id, out);
+        return;
+    }
+    if (ast_[id].kind == NodeKind::ForEach) {
+        // Its variable may share a name set elsewhere in the block.
+        known_.erase(ast_[id].name);
+        forget_assigned(ast_.children(id));
+        fold_block(id);
+        forget_assigned(ast_.children(id));
+        out.push_back(id);
+        return;
+    }
+    if (ast_[id].kind == NodeKind::Match) {
+        // Each arm starts from the values before the match; afterwards
+        // only what no arm assigns is still known.
+        auto outer = known_;
+        for (NodeId arm : ast_.children(id)) {
+            known_ = outer;
+            for (std::string_view name : arm_bindings(ast_[arm].text)) known_.erase(name);
+            fold_block(arm);
+        }
+        known_ = std::move(outer);
+        forget_assigned(ast_.children(id));
+        out.push_back(id);
+        return;
+    }
+    if (ast_[id].kind == NodeKind::Spawn) {
+        // Its copies start from the values at the spawn and never flow back.
+        auto outer = known_;
+        fold_block(id);
+        known_ = std::move(outer);
+        out.push_back(id);
+        return;
+    }
+
+    out.push_back(id);
+    Node& stmt = ast_[id];
+
+    if (stmt.kind == NodeKind::Say || stmt.kind == NodeKind::FunctionCall) {
+        for (NodeId arg_id : ast_.children(stmt)) {
+            Node& arg = ast_[arg_id];
+            if (arg.kind == NodeKind::Variable && !declared_.count(arg.name)) continue;
+            Number value;
+            if (!value_of(arg, value)) continue;
+            if (stmt.kind == NodeKind::Say) {
+                arg.kind = NodeKind::StringLiteral;
+                arg.text = ast_.intern(format_number(value.type, value.i, value.f));
+            }
+            else {
+                respell(arg, value);
+            }
+        }
+        return;
+    }
+
+    if (stmt.kind == NodeKind::Pipeline) {
+        for (NodeId stage : ast_.children(stmt)) fold_stage(ast_[stage]);
+        return;
+    }
+
+    if (stmt.kind == NodeKind::ListDef && !stmt.text.empty()) {
+        const RecordType& type = *records_.find(stmt.text);
+        for (NodeId record : ast_.children(stmt)) {
+            const std::vector<RecordField>& fields = type.has_cases()
+                ? type.cases[type.find_case(ast_[record].name)].fields : type.fields;
+            ChildRange values = ast_.children(record);
+            for (size_t k = 0; k < values.size(); ++k) {
+                if (fields[k].type == NumType::None) continue;
+                Number value = parse_literal(ast_[values[k]]);
+                if (fields[k].type == NumType::Float && value.type == NumType::Int) {
+                    value = Number{ NumType::Float, 0, static_cast<double>(value.i) };
+                }
+                respell(ast_[values[k]], value);
+            }
+        }
+        return;
+    }
+
+    if (stmt.kind == NodeKind::ListDef) {
+        if (stmt.type == NumType::None) return;
+        for (NodeId item : ast_.children(stmt)) {
+            Number value = parse_literal(ast_[item]);
+            if (stmt.type == NumType::Float && value.type == NumType::Int) {
+                value = Number{ NumType::Float, 0, static_cast<double>(value.i) };
+            }
+            respell(ast_[item], value);
+        }
+        return;
+    }
+
+    if (stmt.kind != NodeKind::Set && !is_arithmetic(stmt.kind)) return;
+
+    Number operand;
+    bool operand_known = true;
+    if (stmt.count) {
+        Node& value = ast_[operand_id(stmt)];
+        operand_known = value_of(value, operand);
+        if (operand_known) {
+            if (stmt.type == NumType::Float && operand.type == NumType::Int) {
+                operand = Number{ NumType::Float, 0, static_cast<double>(operand.i) };
+            }
+            respell(value, operand);
+        }
+    }
+
+    if (stmt.kind == NodeKind::Set) {
+        if (operand_known) known_[stmt.name] = operand;
+        else known_.erase(stmt.name);
+        return;
+    }
+
+    auto target = known_.find(stmt.name);
+    if (!operand_known || target == known_.end()) {
+        if (stmt.kind == NodeKind::Divide && operand_known && stmt.type == NumType::Int && operand.i == 0) {
+            fail(stmt, "division by zero");
+        }
+        known_.erase(stmt.name);
+        return;
+    }
+
+    Number result = target->second;
+    if (stmt.type == NumType::Float) {
+        double a = result.as_float();
+        double b = operand.as_float();
+        double r = stmt.kind == NodeKind::Add ? a + b
+            : stmt.kind == NodeKind::Minus ? a - b
+            : stmt.kind == NodeKind::Multiply ? a * b
+            : a / b;
+        // inf and nan have no literal spelling; leave those to run time.
+        if (!std::isfinite(r)) {
+            known_.erase(stmt.name);
+            return;
+        }
+        result = Number{ NumType::Float, 0, r };
+    }
+    else {
+        // Wrap on overflow, as the machine does, instead of relying on
+        // undefined behaviour in the compiler.
+        uint64_t a = static_cast<uint64_t>(result.i);
+        uint64_t b = static_cast<uint64_t>(operand.i);
+        switch (stmt.kind) {
+        case NodeKind::Add:      result.i = static_cast<int64_t>(a + b); break;
+        case NodeKind::Minus:    result.i = static_cast<int64_t>(a - b); break;
+        case NodeKind::Multiply: result.i = static_cast<int64_t>(a * b); break;
+        default:
+            if (operand.i == 0) fail(stmt, "division by zero");
+            result.i = operand.i == -1 ? static_cast<int64_t>(0 - a) : result.i / operand.i;
+            break;
+        }
+    }
+
+    known_[stmt.name] = result;
+    stmt.kind = NodeKind::Set;
+    respell(ast_[operand_id(stmt)], result);
+}
+
+// A loop with a known, small trip count is replaced by that many copies of
+// its body, which then fold like straight-line code: literal output joins
+// one run and arithmetic settles at compile time. Any other loop is kept,
+// with what it assigns treated as unknown inside and after it, so only
+// values that stay the same on every iteration are folded into its body.
+void Folder::fold_repeat(NodeId id, std::vector<NodeId>& out) {
+    Node& loop = ast_[id];
+    Number count;
+    bool known = true;
+    if (loop.name.empty()) count = parse_literal(loop);
+    else known = value_of(variable_node(loop), count);
+
+    if (known) {
+        loop.name = {};
+        loop.text = ast_.intern(format_number(NumType::Int, count.i, 0));
+
+        size_t weight = unrolled_size(ast_.children(loop));
+        if (count.i > 0 && weight != 0 && static_cast<uint64_t>(count.i) <= kMaxUnrolledStatements / weight) {
+            ChildRange children = ast_.children(loop);
+            std::vector<NodeId> body(children.begin(), children.end());
+            // Copies come from the body before it is folded; the last pass
+            // folds the original nodes.
+            for (int64_t i = 1; i < count.i; ++i) {
+                for (NodeId stmt : body) fold_statement(clone(stmt), out);
+            }
+            for (NodeId stmt : body) fold_statement(stmt, out);
+            return;
+        }
+    }
+
+    forget_assigned(ast_.children(id));
+    fold_block(id);
+    forget_assigned(ast_.children(id));
+    out.push_back(id);
+}
+
+// A stage's operand becomes a literal when its value is known. Dividing
+// integers by a known zero is an error, as it is for `divide`.
+void Folder::fold_stage(const Node& stage) {
+    Node& operand = ast_[operand_id(stage)];
+    if (operand.kind == NodeKind::StringLiteral || operand.name == stage.name) return;
+    Number value;
+    if (!value_of(operand, value)) return;
+    if (stage.kind == NodeKind::Transform && stage.text == "/" && stage.type == NumType::Int &&
+        value.type == NumType::Int && value.i == 0) {
+        fail(stage, "division by zero");
+    }
+    respell(operand, value);
+}
+
+void Folder::forget_assigned(ChildRange body) {
+    for (NodeId id : body) {
+        const Node& stmt = ast_[id];
+        if (stmt.kind == NodeKind::Set || is_arithmetic(stmt.kind)) known_.erase(stmt.name);
+        else if (is_loop(stmt.kind) || is_match(stmt.kind)) forget_assigned(ast_.children(stmt));
+    }
+}
+
+// Statements a loop body stands for once unrolled, nested loops counting
+// their bodies in full.
+size_t Folder::unrolled_size(ChildRange body) const {
+    size_t size = 0;
+    for (NodeId id : body) {
+        const Node& stmt = ast_[id];
+        size += 1 + (has_body(stmt.kind) ? unrolled_size(ast_.children(stmt)) : 0);
+    }
+    return size;
+}
+
+NodeId Folder::clone(NodeId id) {
+    ChildRange children = ast_.children(id);
+    std::vector<NodeId> copies(children.begin(), children.end());
+    for (NodeId& child : copies) child = clone(child);
+
+    Node node = ast_[id];
+    NodeId copy = ast_.add(node);
+    size_t mark = ast_.open_list();
+    for (NodeId child : copies) ast_.push_child(child);
+    ast_.close_list(copy, mark);
+    return copy;
+}
+
+// Variables whose value is still read at run time. Folding replaces every
+// read of a known value with a literal, so often there are none left.
+void Folder::find_live(ChildRange body, std::unordered_set<std::string_view>& live) const {
+    for (NodeId id : body) {
+        const Node& stmt = ast_[id];
+        if (is_arithmetic(stmt.kind) || (stmt.kind == NodeKind::Repeat && !stmt.name.empty())) live.insert(stmt.name);
+        if (has_body(stmt.kind)) {
+            find_live(ast_.children(stmt), live);
+            continue;
+        }
+        if (stmt.kind == NodeKind::Pipeline) {
+            for (NodeId stage : ast_.children(stmt)) {
+                const Node& operand = ast_[operand_id(ast_[stage])];
+                if (operand.kind == NodeKind::Variable) live.insert(operand.name);
+            }
+            continue;
+        }
+        for (NodeId operand : ast_.children(stmt)) {
+            if (ast_[operand].kind == NodeKind::Variable) live.insert(ast_[operand].name);
+        }
+        // A method is given the whole record, with every field set so far.
+        if (stmt.kind == NodeKind::FunctionCall && is_path(stmt.name)) live.insert(path_base(stmt.name));
+    }
+}
+
+// Removes the `set`s of variables nothing reads, such as the running
+// totals of an unrolled loop.
+void Folder::drop_dead_sets(NodeId block, const std::unordered_set<std::string_view>& live) {
+    ChildRange children = ast_.children(block);
+    std::vector<NodeId> body(children.begin(), children.end());
+    std::vector<NodeId> kept;
+    kept.reserve(body.size());
+    for (NodeId id : body) {
+        const Node& stmt = ast_[id];
+        if (stmt.kind == NodeKind::Set && !live.count(stmt.name) &&
+            !(is_path(stmt.name) && live.count(path_base(stmt.name)))) {
+            continue;
+        }
+        if (has_body(stmt.kind)) drop_dead_sets(id, live);
+        kept.push_back(id);
+    }
+    if (kept.size() == body.size()) return;
+
+    size_t mark = ast_.open_list();
+    for (NodeId id : kept) ast_.push_child(id);
+    ast_.close_list(block, mark);
+}
+
+} // namespace
+
+void fold_constants(AST& ast, NodeId block, RecordTable& records) {
+    NodeKind kind = ast[block].kind;
+    if (kind == NodeKind::FunctionDef || kind == NodeKind::StartBlock) {
+        Folder(ast, block, records).run();
+    }
+    else if (kind == NodeKind::TypeDef) {
+        records.add(ast, block);
+        for (NodeId member : ast.children(block)) {
+            if (ast[member].kind == NodeKind::Method) Folder(ast, member, records).run();
+        }
+    }
+}
+
+void fold_constants(AST& ast) {
+    RecordTable records;
+    for (NodeId id : ast.statements) fold_constants(ast, id, records);
+}
@@ -0,0 +1,53 @@
+// fold.hpp - Numeric typing and constant folding over the AST
+#pragma once
+#include "ast.hpp"
+#include "records.hpp"
+#include <cstdint>
+#include <string>
+
+// Types the numeric variables of one function or start block and folds
+// every value known at compile time, rewriting nodes in place:
+//  - a variable is Float if any `set` or arithmetic gives it a
+//    floating-point value, directly or through another variable, and Int
+//    otherwise; Set and arithmetic nodes record it in Node::type;
+//  - arithmetic on known values becomes a `set` of the result;
+//  - known variables and number literals printed by `say` become the text
+//    they print, and known call arguments and pipeline operands become
+//    number literals;
+//  - number literals are respelled canonically ("007" becomes "7"), and
+//    a `repeat` count that is known becomes a literal;
+//  - ListDef, ForEach and Pipeline nodes record their element type, and
+//    Filter and Transform stages the type of the element they are given;
+//  - a `repeat` with a known count whose unrolled body stays small is
+//    replaced by the copies of its body;
+//  - a spawned block starts from the values known where it is spawned,
+//    and nothing it sets is known outside it;
+//  - a list of records records its type in ListDef::text, and its number
+//    fields are respelled as the field's type; a match_gently records the
+//    type of what it matches in Match::text;
+//  - each arm of a match_gently starts from the values known before it,
+//    and what any arm sets is unknown after it;
+//  - `set`s of variables that are no longer read anywhere are dropped.
+// Both backends then only ever see numbers they can emit as they are.
+//
+// Throws std::runtime_error for arithmetic on anything but a number `set`
+// earlier in the same block (parameters included), for setting a
+// parameter, for integer literals out of range, for integer division by
+// zero, for a `repeat` count that is not a whole number, for lists
+// that mix text and numbers, are made inside a loop, or are used other
+// than by `for each`, for pipeline stages that mix text and numbers, for
+// `await_all_with_patience` inside a spawned block, for records that do
+// not match their type, for unknown fields, methods and cases, for
+// changing a field of anything but `self` or giving a Number field a
+// fraction, and for a match_gently that leaves a case unhandled.
+//
+// A TypeDef is added to `records` and its methods are folded; the blocks
+// after it may then use the type.
+void fold_constants(AST& ast, NodeId block, RecordTable& records);
+
+// The same for every top-level statement.
+void fold_constants(AST& ast);
+
+// How a number is printed: integers in decimal, doubles like printf's %g.
+// Folding and the VM use it; libherlang_rt prints the same way.
+std::string format_number(NumType type, int64_t i, double f);
@@ -6,13 +6,16 @@
 #include <string>
 #include <algorithm>
 #include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
 
 
 static std::string indent(int level) {
     return std::string(level * 4, ' ');
 }
 
-static std::string escape_string(const std::string& s) {
+static std::string escape_string(std::string_view s) {
     std::string out;
     for (char c : s) {
         if (c == '\"') out += "\\\"";
@@ -22,89 +25,902 @@ static std::string escape_string(const std::string& s) {
     return out;
 }
 
-static void gen_stmt(std::ostringstream& out, const std::shared_ptr<Statement>& stmt, int indent_level = 1) {
+static void gen_operand(std::ostream& out, const Node& arg) {
+    if (arg.kind == NodeKind::StringLiteral) {
+        out << "\"" << escape_string(arg.text) << "\"";
+    }
+    else if (arg.kind == NodeKind::NumberLiteral) {
+        // Folding has already spelled it as C++ would: "12" or "2.5". The
+        // one exception is INT64_MIN, whose digits alone overflow.
+        if (arg.text == "-9223372036854775808") out << "(-9223372036854775807LL - 1)";
+        else out << arg.text;
+    }
+    else {
+        out << arg.name;
+    }
+}
+
+// True for a `say` whose output is known at compile time.
+static bool is_literal_say(const AST& ast, const Node& stmt) {
+    if (stmt.kind != NodeKind::Say) return false;
+    for (NodeId arg : ast.children(stmt)) {
+        if (ast[arg].kind != NodeKind::StringLiteral) return false;
+    }
+    return true;
+}
+
+// The exact bytes a literal `say` prints. Only the default ending "\n" is
+// an escape; any other end= text is written as spelled, as gen_stmt does.
+static void append_say_bytes(std::string& blob, const AST& ast, const Node& stmt) {
+    for (NodeId arg : ast.children(stmt)) blob += ast[arg].text;
+    if (stmt.text == "\\n") blob += '\n';
+    else blob += stmt.text;
+}
+
+// Spells arbitrary bytes as a C++ string literal. Octal escapes always use
+// three digits so a following digit is never absorbed into them.
+static void gen_bytes_literal(std::ostream& out, std::string_view bytes) {
+    static const char digits[] = "01234567";
+    out << '"';
+    for (char c : bytes) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"') out << "\\\"";
+        else if (c == '\\') out << "\\\\";
+        else if (c == '\n') out << "\\n";
+        else if (u < 0x20 || u == 0x7f) out << '\\' << digits[u >> 6] << digits[(u >> 3) & 7] << digits[u & 7];
+        else out << c;
+    }
+    out << '"';
+}
+
+static void gen_stmt(std::ostream& out, const AST& ast, NodeId id, const CodegenOptions& options,
+    const CallGraph* calls, const RecordTable& types, int indent_level = 1);
+
+// Stands for the flush a FunctionDef does on return under
+// FlushPolicy::Block, where an inlined body has been spliced in.
+static constexpr NodeId kBlockFlush = static_cast<NodeId>(-1);
+
+// An inlined function with no parameter and no variables of its own can be
+// spliced straight into its caller, so its literal output joins the
+// caller's runs. Anything else is inlined as a nested scope.
+static bool splices(const AST& ast, const Node& def) {
+    if (!def.text.empty()) return false;
+    for (NodeId s : ast.children(def)) {
+        if (ast[s].kind == NodeKind::Set) return false;
+    }
+    return true;
+}
+
+using Declared = std::unordered_set<std::string_view>;
+
+// What is in scope in one C++ function: the names of its parameter (or
+// `self`), the numbers declared so far and the variables of the loops
+// around, and which of its lists hold records.
+struct Scope {
+    const RecordTable& types;
+    Declared names;
+    std::unordered_map<std::string_view, const RecordType*> records;
+};
+
+static bool gen_body(std::ostream& out, const AST& ast, ChildRange body, const CodegenOptions& options,
+    const CallGraph* calls, int indent_level, Scope& scope);
+
+// Marks every variable a body assigns, in order, and collects those whose
+// first assignment is not a plain `set` at the top of the function: the
+// ones first set inside a loop must be declared before it to stay in
+// scope after it. Fields of `self` are part of it already.
+static void find_hoisted(const AST& ast, ChildRange body, bool top, Declared& seen,
+    std::vector<const Node*>& hoisted) {
+    for (NodeId id : body) {
+        const Node& stmt = ast[id];
+        if (has_body(stmt.kind)) {
+            find_hoisted(ast, ast.children(stmt), false, seen, hoisted);
+        }
+        else if ((stmt.kind == NodeKind::Set || stmt.kind == NodeKind::Add || stmt.kind == NodeKind::Minus ||
+                     stmt.kind == NodeKind::Multiply || stmt.kind == NodeKind::Divide) &&
+            !is_path(stmt.name) && seen.insert(stmt.name).second && !(top && stmt.kind == NodeKind::Set)) {
+            hoisted.push_back(&stmt);
+        }
+    }
+}
+
+// Starts the body of a C++ function: declares the hoisted variables and
+// returns the set that the rest of the body adds to.
+static Declared declare_hoisted(std::ostream& out, const AST& ast, ChildRange body, const std::string& ind) {
+    Declared seen;
+    std::vector<const Node*> hoisted;
+    find_hoisted(ast, body, true, seen, hoisted);
+
+    Declared declared;
+    for (const Node* stmt : hoisted) {
+        out << ind << (stmt->type == NumType::Float ? "double " : "long long ") << stmt->name << " = 0;\n";
+        declared.insert(stmt->name);
+    }
+    return declared;
+}
+
+static void gen_set(std::ostream& out, const AST& ast, const Node& stmt, bool declare, const std::string& ind) {
+    out << ind;
+    if (declare) out << (stmt.type == NumType::Float ? "double " : "long long ");
+    out << stmt.name << " = ";
+    if (stmt.count) gen_operand(out, ast[ast.children(stmt)[0]]);
+    else out << '0';
+    out << ";\n";
+}
+
+// Integer division goes through the runtime unless the divisor is a
+// literal that can neither be zero nor overflow (INT64_MIN / -1).
+static void gen_arithmetic(std::ostream& out, const AST& ast, const Node& stmt, const std::string& ind) {
+    const Node& operand = ast[ast.children(stmt)[0]];
+    if (stmt.kind == NodeKind::Divide && stmt.type == NumType::Int &&
+        !(operand.kind == NodeKind::NumberLiteral && operand.text != "0" && operand.text != "-1")) {
+        out << ind << stmt.name << " = herlang::runtime::divide(" << stmt.name << ", ";
+        gen_operand(out, operand);
+        out << ");\n";
+        return;
+    }
+
+    const char* op = stmt.kind == NodeKind::Add ? " += "
+        : stmt.kind == NodeKind::Minus ? " -= "
+        : stmt.kind == NodeKind::Multiply ? " *= "
+        : " /= ";
+    out << ind << stmt.name << op;
+    gen_operand(out, operand);
+    out << ";\n";
+}
+
+// Returns whether the inlined body ends by flushing the output.
+static bool gen_inline(std::ostream& out, const AST& ast, const Node& call, const Node& def,
+    const CodegenOptions& options, const CallGraph* calls, const RecordTable& types, int indent_level) {
     std::string ind = indent(indent_level);
+    out << ind << "{\n";
+    ChildRange args = ast.children(call);
+    // The callee never sets its parameter, so an argument that already has
+    // the parameter's name can be used as it is.
+    if (!args.empty() && !(ast[args[0]].kind == NodeKind::Variable && ast[args[0]].name == def.text)) {
+        out << indent(indent_level + 1) << "auto " << def.text << " = ";
+        gen_operand(out, ast[args[0]]);
+        out << ";\n";
+    }
+    Scope scope{ types, declare_hoisted(out, ast, ast.children(def), indent(indent_level + 1)), {} };
+    bool flushed = gen_body(out, ast, ast.children(def), options, calls, indent_level + 1, scope);
+    if (options.flush == FlushPolicy::Block && !flushed) out << indent(indent_level + 1) << "herlang::runtime::flush();\n";
+    out << ind << "}\n";
+    return flushed || options.flush == FlushPolicy::Block;
+}
+
+// The trip count is copied into the loop counter, so the body may change
+// the variable it came from. Counters are named after their depth, which
+// keeps nested loops apart. A loop folding found never runs is left out;
+// what it would have set is declared at the top of the function anyway.
+static void gen_repeat(std::ostream& out, const AST& ast, const Node& loop, const CodegenOptions& options,
+    const CallGraph* calls, int indent_level, Scope& scope) {
+    if (never_runs(loop)) return;
+    std::string ind = indent(indent_level);
+    std::string counter = "herlang_repeat" + std::to_string(indent_level);
+    out << ind << "for (long long " << counter << " = " << (loop.name.empty() ? loop.text : loop.name) << "; "
+        << counter << " > 0; --" << counter << ") {\n";
+    gen_body(out, ast, ast.children(loop), options, calls, indent_level + 1, scope);
+    out << ind << "}\n";
+}
+
+// A switch on the tag with one dense case label per case, which the C++
+// compiler turns into a jump table. An arm reads the fields it binds in
+// place, from the payload inside the record.
+static void gen_match(std::ostream& out, const AST& ast, const Node& match, const CodegenOptions& options,
+    const CallGraph* calls, int indent_level, Scope& scope) {
+    std::string ind = indent(indent_level);
+    std::string inner = indent(indent_level + 1);
+    const RecordType& type = *scope.types.find(match.text);
 
-    if (auto say = dynamic_cast<SayStatement*>(stmt.get())) {
-        out << ind << "std::cout";
-        for (size_t i = 0; i < say->args.size(); ++i) {
-            out << " << ";
-            if (say->is_vars[i]) {
-                out << say->args[i];
+    out << ind << "switch (" << match.name << ".tag) {\n";
+    for (NodeId id : ast.children(match)) {
+        const Node& arm = ast[id];
+        std::vector<std::string_view> fresh;
+        if (arm.name == "_") {
+            out << ind << "default: {\n";
+        }
+        else {
+            int index = type.find_case(arm.name);
+            out << ind << "case " << index << ": {\n";
+            std::vector<std::string_view> names = arm_bindings(arm.text);
+            for (size_t k = 0; k < names.size(); ++k) {
+                if (names[k] == "_") continue;
+                out << inner << "[[maybe_unused]] const auto& " << names[k] << " = " << match.name << ".payload."
+                    << arm.name << "." << type.cases[index].fields[k].name << ";\n";
+                if (scope.names.insert(names[k]).second) fresh.push_back(names[k]);
+            }
+        }
+        gen_body(out, ast, ast.children(arm), options, calls, indent_level + 1, scope);
+        for (std::string_view name : fresh) scope.names.erase(name);
+        out << inner << "break;\n";
+        out << ind << "}\n";
+    }
+    out << ind << "}\n";
+}
+
+static const char* element_type(NumType type) {
+    switch (type) {
+    case NumType::Int:   return "long long";
+    case NumType::Float: return "double";
+    default:             return "herlang::runtime::Str";
+    }
+}
+
+// An index loop over the list's contiguous storage, with the size read
+// once so the C++ compiler can see the trip count. A record is used in
+// place; from a list of columns, only the fields the body reads are
+// copied into it, so a loop reading one field streams one column.
+static void gen_for_each(std::ostream& out, const AST& ast, const Node& loop, const CodegenOptions& options,
+    const CallGraph* calls, int indent_level, Scope& scope) {
+    std::string ind = indent(indent_level);
+    std::string inner = indent(indent_level + 1);
+    std::string level = std::to_string(indent_level);
+    std::string index = "herlang_index" + level;
+    std::string size = "herlang_size" + level;
+    auto records = scope.records.find(loop.text);
+    const RecordType* type = records != scope.records.end() ? records->second : nullptr;
+
+    out << ind << "for (std::size_t " << index << " = 0, " << size << " = " << loop.text;
+    if (type && type->columns) out << "." << type->fields[0].name;
+    out << ".size(); " << index << " < " << size << "; ++" << index << ") {\n";
+    if (!type) {
+        out << inner << "[[maybe_unused]] const auto " << loop.name << " = " << loop.text << "[" << index << "];\n";
+    }
+    else if (!type->columns) {
+        out << inner << "[[maybe_unused]] const " << type->name << "& " << loop.name << " = " << loop.text << "[" << index << "];\n";
+    }
+    else {
+        out << inner << "[[maybe_unused]] " << type->name << " " << loop.name << "{};\n";
+        std::vector<bool> used = used_fields(ast, ast.children(loop), loop.name, *type);
+        for (size_t k = 0; k < used.size(); ++k) {
+            if (!used[k]) continue;
+            const std::string& field = type->fields[k].name;
+            out << inner << loop.name << "." << field << " = " << loop.text << "." << field << "[" << index << "];\n";
+        }
+    }
+    bool fresh = scope.names.insert(loop.name).second;
+    gen_body(out, ast, ast.children(loop), options, calls, indent_level + 1, scope);
+    if (fresh) scope.names.erase(loop.name);
+    out << ind << "}\n";
+}
+
+
+static void gen_item(std::ostream& out, const Node& item) {
+    if (item.kind == NodeKind::StringLiteral) {
+        out << "{ ";
+        gen_bytes_literal(out, item.text);
+        out << ", " << item.text.size() << " }";
+    }
+    else {
+        gen_operand(out, item);
+    }
+}
+
+// Records go into a static array of structs, or one static array per field
+// for a type stored as columns, from which the list is built like any other.
+// Values of a type with cases are structs too, each a tag and its case's
+// fields; all of them are constants, so the array is read-only data.
+static void gen_record_list(std::ostream& out, const AST& ast, const Node& list, const RecordType& type,
+    const std::string& ind) {
+    std::string items = "herlang_items_" + std::string(list.name);
+    ChildRange records = ast.children(list);
+    if (!type.columns) {
+        out << ind << "static const " << type.name << " " << items << "[] = {";
+        for (NodeId id : records) {
+            out << "\n" << ind << "    { ";
+            if (type.has_cases()) {
+                // The tag, then the payload of that case.
+                out << type.find_case(ast[id].name) << ", " << type.name << "::herlang_" << ast[id].name
+                    << (ast[id].count ? "{ " : "{");
+            }
+            const char* sep = "";
+            for (NodeId value : ast.children(id)) {
+                out << sep;
+                gen_item(out, ast[value]);
+                sep = ", ";
+            }
+            if (type.has_cases()) out << (ast[id].count ? " } }," : "} },");
+            else out << " },";
+        }
+        out << "\n" << ind << "};\n";
+        out << ind << "herlang::runtime::List<" << type.name << "> " << list.name << "(" << items << ", " << list.count << ");\n";
+        return;
+    }
+
+    for (size_t k = 0; k < type.fields.size(); ++k) {
+        out << ind << "static const " << element_type(type.fields[k].type) << " " << items << "_" << type.fields[k].name << "[] = {";
+        for (NodeId id : records) {
+            out << "\n" << ind << "    ";
+            gen_item(out, ast[ast.children(id)[k]]);
+            out << ",";
+        }
+        out << "\n" << ind << "};\n";
+    }
+    out << ind << "herlang_" << type.name << "_columns " << list.name << "{\n";
+    for (const RecordField& field : type.fields) {
+        out << ind << "    { " << items << "_" << field.name << ", " << list.count << " },\n";
+    }
+    out << ind << "};\n";
+}
+
+// The elements go into a static array; the list is built from it in one
+// allocation of exactly their number.
+static void gen_list(std::ostream& out, const AST& ast, const Node& list, const std::string& ind, Scope& scope) {
+    if (!list.text.empty()) {
+        const RecordType* record = scope.types.find(list.text);
+        scope.records[list.name] = record;
+        gen_record_list(out, ast, list, *record, ind);
+        return;
+    }
+    const char* type = element_type(list.type);
+    if (!list.count) {
+        out << ind << "herlang::runtime::List<" << type << "> " << list.name << ";\n";
+        return;
+    }
+
+    std::string items = "herlang_items_" + std::string(list.name);
+    out << ind << "static const " << type << " " << items << "[] = {";
+    for (NodeId id : ast.children(list)) {
+        out << "\n" << ind << "    ";
+        gen_item(out, ast[id]);
+        out << ",";
+    }
+    out << "\n" << ind << "};\n";
+    out << ind << "herlang::runtime::List<" << type << "> " << list.name << "(" << items << ", " << list.count << ");\n";
+}
+
+// A stage operand; the stage's own element variable is the value it is
+// given, `value`.
+static void gen_stage_operand(std::ostream& out, const Node& stage, const Node& operand, const std::string& value) {
+    if (operand.kind == NodeKind::Variable && operand.name == stage.name) {
+        out << value;
+    }
+    else if (operand.kind == NodeKind::StringLiteral) {
+        out << "herlang::runtime::Str{ ";
+        gen_bytes_literal(out, operand.text);
+        out << ", " << operand.text.size() << " }";
+    }
+    else {
+        gen_operand(out, operand);
+    }
+}
+
+// The whole chain of stages runs on one element at a time inside a single
+// fill() pass, so no list is built between stages. Each calculation names
+// its result herlang_valueN; a filter returns early for elements it drops.
+static void gen_pipeline(std::ostream& out, const AST& ast, const Node& pipeline, const CodegenOptions& options,
+    const std::string& ind) {
+    ChildRange stages = ast.children(pipeline);
+    const char* type = element_type(pipeline.type);
+    out << ind << "herlang::runtime::List<" << type << "> " << pipeline.name << ";\n";
+    out << ind << pipeline.name << ".fill(" << pipeline.text << ", [&](" << element_type(ast[stages[0]].type)
+        << " herlang_value0, " << type << "& herlang_out) {\n";
+
+    std::string inner = ind + "    ";
+    int step = 0;
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const Node& stage = ast[stages[i]];
+        const Node& operand = ast[ast.children(stage)[0]];
+        std::string value = "herlang_value" + std::to_string(step);
+        std::string_view op = stage.text;
+
+        if (stage.kind == NodeKind::Filter) {
+            out << inner << "if (";
+            if (stage.type != NumType::None) {
+                out << "!(" << value << " " << op << " ";
+                gen_stage_operand(out, stage, operand, value);
+                out << ")";
             }
             else {
-                out << "\"" << escape_string(say->args[i]) << "\"";
+                // Text is tested by the runtime: equals, contains, starts_with, ends_with.
+                std::string_view test = op == "==" || op == "!=" ? "equals" : op;
+                out << (op == "!=" ? "" : "!") << "herlang::runtime::" << test << "(" << value << ", ";
+                gen_stage_operand(out, stage, operand, value);
+                out << ")";
             }
+            out << ") return false;\n";
+            continue;
         }
 
-        if (say->end == "\\n")
-            out << " << std::endl;\n";
-        else
-            out << " << \"" << escape_string(say->end) << "\";\n";
+        // What a calculation makes is what the next stage is given.
+        NumType made = i + 1 < stages.size() ? ast[stages[i + 1]].type : pipeline.type;
+        std::string result = "herlang_value" + std::to_string(++step);
+        out << inner << "const " << element_type(made) << " " << result << " = ";
+        if (op == "/" && made == NumType::Int &&
+            !(operand.kind == NodeKind::NumberLiteral && operand.text != "0" && operand.text != "-1")) {
+            out << "herlang::runtime::divide(" << value << ", ";
+            gen_stage_operand(out, stage, operand, value);
+            out << ")";
+        }
+        else {
+            out << value << " " << op << " ";
+            gen_stage_operand(out, stage, operand, value);
+        }
+        out << ";\n";
     }
-    else if (auto set = dynamic_cast<SetStatement*>(stmt.get())) {
-        out << ind << "auto " << set->var << " = 0;\n";
+    out << inner << "herlang_out = herlang_value" << step << ";\n";
+    out << inner << "return true;\n";
+    out << ind << (options.parallel_lists ? "});\n" : "}, false);\n");
+}
+
+// Every variable a body reads or changes, nested bodies included, in the
+// order they first appear; a method call reads its record, and so does a
+// match_gently.
+static void find_used(const AST& ast, ChildRange body, Declared& seen, std::vector<std::string_view>& used) {
+    auto use = [&](std::string_view name) {
+        if (seen.insert(name).second) used.push_back(name);
+    };
+    for (NodeId id : body) {
+        const Node& stmt = ast[id];
+        if (stmt.kind == NodeKind::Set || stmt.kind == NodeKind::Add || stmt.kind == NodeKind::Minus ||
+            stmt.kind == NodeKind::Multiply || stmt.kind == NodeKind::Divide ||
+            (stmt.kind == NodeKind::Repeat && !stmt.name.empty()) || stmt.kind == NodeKind::Match ||
+            (stmt.kind == NodeKind::FunctionCall && is_path(stmt.name))) {
+            use(stmt.name);
+        }
+        if (has_body(stmt.kind)) {
+            find_used(ast, ast.children(stmt), seen, used);
+            continue;
+        }
+        for (NodeId operand : ast.children(stmt)) {
+            if (ast[operand].kind == NodeKind::Variable) use(ast[operand].name);
+        }
+    }
+}
+
+// A spawned block becomes a lambda handed to the function's TaskGroup. It
+// captures copies of the variables it uses, records whole, which may
+// change or go out of scope while it runs, and the lists by reference:
+// they are never changed and the function waits for its blocks before it
+// returns.
+static void gen_spawn(std::ostream& out, const AST& ast, const Node& block, const CodegenOptions& options,
+    const CallGraph* calls, int indent_level, Scope& scope) {
+    std::string ind = indent(indent_level);
+    Declared seen;
+    std::vector<std::string_view> used;
+    find_used(ast, ast.children(block), seen, used);
+
+    out << ind << "herlang_tasks.spawn([&";
+    Declared captured;
+    for (std::string_view name : used) {
+        std::string_view var = is_path(name) ? path_base(name) : name;
+        if (scope.names.count(var) && captured.insert(var).second) out << ", " << var << " = " << var;
     }
-    else if (auto func = dynamic_cast<FunctionDef*>(stmt.get())) {
-        if (!func->param.empty()) {
-            out << "void " << func->name << "(auto " << func->param << ") {\n";
+    out << "]() mutable {\n";
+    bool flushed = gen_body(out, ast, ast.children(block), options, calls, indent_level + 1, scope);
+    if (options.flush == FlushPolicy::Block && !flushed) out << indent(indent_level + 1) << "herlang::runtime::flush();\n";
+    out << ind << "});\n";
+}
+
+// True if a body spawns blocks or waits for them.
+static bool uses_tasks(const AST& ast, ChildRange body) {
+    for (NodeId id : body) {
+        const Node& stmt = ast[id];
+        if (stmt.kind == NodeKind::Spawn || stmt.kind == NodeKind::AwaitAll) return true;
+        if (has_body(stmt.kind) && uses_tasks(ast, ast.children(stmt))) return true;
+    }
+    return false;
+}
+
+// The body of a function, a method or the start block. One that spawns
+// blocks owns the TaskGroup they run in and waits for them at its end,
+// while its lists are still alive. Returns whether it ends by flushing the
+// output.
+static bool gen_function_body(std::ostream& out, const AST& ast, const Node& def, const CodegenOptions& options,
+    const CallGraph* calls, const RecordTable& types, int indent_level) {
+    std::string ind = indent(indent_level);
+    Scope scope{ types, declare_hoisted(out, ast, ast.children(def), ind), {} };
+    if (def.kind == NodeKind::FunctionDef && !def.text.empty()) scope.names.insert(def.text);
+    if (def.kind == NodeKind::Method) scope.names.insert("self");
+    bool tasks = uses_tasks(ast, ast.children(def));
+    if (tasks) out << ind << "herlang::runtime::TaskGroup herlang_tasks;\n";
+    bool flushed = gen_body(out, ast, ast.children(def), options, calls, indent_level, scope);
+    if (!tasks) return flushed;
+    out << ind << "herlang_tasks.wait();\n";
+    return false;
+}
+
+// Emits a block body. Each run of consecutive literal `say` statements is
+// folded into one byte blob written with a single call; nothing can run
+// between them, so under FlushPolicy::Line one flush after the run is
+// indistinguishable from one per line. A flush straight after another one
+// has nothing to hand over and is left out. Returns whether the body ends
+// by flushing the output, so the caller can leave out its own.
+static bool gen_body(std::ostream& out, const AST& ast, ChildRange body, const CodegenOptions& options,
+    const CallGraph* calls, int indent_level, Scope& scope) {
+    std::string ind = indent(indent_level);
+    std::string blob;
+    bool flushed = false;
+
+    auto inlined = [&](NodeId id) -> const Node* {
+        if (!calls) return nullptr;
+        auto it = calls->inlined.find(id);
+        return it != calls->inlined.end() ? &ast[it->second] : nullptr;
+    };
+
+    std::vector<NodeId> items;
+    items.reserve(body.size());
+    for (NodeId id : body) {
+        const Node* def = inlined(id);
+        if (def && splices(ast, *def)) {
+            for (NodeId s : ast.children(*def)) items.push_back(s);
+            if (options.flush == FlushPolicy::Block) items.push_back(kBlockFlush);
         }
         else {
-            out << "void " << func->name << "() {\n";
+            items.push_back(id);
+        }
+    }
+
+    auto literal = [&](NodeId id) { return id != kBlockFlush && is_literal_say(ast, ast[id]); };
+
+    for (size_t i = 0; i < items.size();) {
+        if (!literal(items[i])) {
+            NodeId id = items[i++];
+            if (id == kBlockFlush || ast[id].kind == NodeKind::Flush) {
+                if (!flushed) out << ind << "herlang::runtime::flush();\n";
+                flushed = true;
+                continue;
+            }
+            // Only a line ending `say` flushes, under FlushPolicy::Line.
+            flushed = ast[id].kind == NodeKind::Say && ast[id].text == "\\n" && options.flush == FlushPolicy::Line;
+            // The first `set` of a name declares it, typed as folding decided.
+            if (ast[id].kind == NodeKind::Set) {
+                const Node& set = ast[id];
+                gen_set(out, ast, set, !is_path(set.name) && scope.names.insert(set.name).second, ind);
+            }
+            else if (ast[id].kind == NodeKind::Repeat) gen_repeat(out, ast, ast[id], options, calls, indent_level, scope);
+            else if (ast[id].kind == NodeKind::ForEach) gen_for_each(out, ast, ast[id], options, calls, indent_level, scope);
+            else if (ast[id].kind == NodeKind::ListDef) gen_list(out, ast, ast[id], ind, scope);
+            else if (ast[id].kind == NodeKind::Pipeline) gen_pipeline(out, ast, ast[id], options, ind);
+            else if (ast[id].kind == NodeKind::Spawn) gen_spawn(out, ast, ast[id], options, calls, indent_level, scope);
+            else if (ast[id].kind == NodeKind::Match) gen_match(out, ast, ast[id], options, calls, indent_level, scope);
+            else if (const Node* def = inlined(id)) flushed = gen_inline(out, ast, ast[id], *def, options, calls, scope.types, indent_level);
+            else gen_stmt(out, ast, id, options, calls, scope.types, indent_level);
+            continue;
         }
 
-        for (auto& s : func->body) gen_stmt(out, s, indent_level + 1);
-        out << "}\n";
+        blob.clear();
+        for (; i < items.size() && literal(items[i]); ++i) {
+            append_say_bytes(blob, ast, ast[items[i]]);
+        }
+        if (blob.empty()) continue;
+
+        out << ind << "herlang::runtime::write(";
+        gen_bytes_literal(out, blob);
+        out << ", " << blob.size() << ");\n";
+        flushed = options.flush == FlushPolicy::Line && blob.find('\n') != std::string::npos;
+        if (flushed) out << ind << "herlang::runtime::flush();\n";
+    }
+    return flushed;
+}
+
+static void gen_stmt(std::ostream& out, const AST& ast, NodeId id, const CodegenOptions& options,
+    const CallGraph* calls, const RecordTable& types, int indent_level) {
+    const Node& stmt = ast[id];
+    std::string ind = indent(indent_level);
+
+    switch (stmt.kind) {
+    case NodeKind::Say: {
+        // One runtime call writes the whole line. Neighbouring literal
+        // text, the ending included, becomes one piece of known length;
+        // variables are formatted by the runtime on the stack.
+        std::string_view ending = stmt.text == "\\n" ? std::string_view("\n") : stmt.text;
+        bool empty = ending.empty();
+        for (NodeId arg : ast.children(stmt)) {
+            if (ast[arg].kind != NodeKind::StringLiteral || !ast[arg].text.empty()) empty = false;
+        }
+        if (empty) break;
+
+        out << ind << "herlang::runtime::say({ ";
+        std::string text;
+        const char* sep = "";
+        auto gen_text = [&]() {
+            if (text.empty()) return;
+            out << sep << "{ ";
+            gen_bytes_literal(out, text);
+            out << ", " << text.size() << " }";
+            sep = ", ";
+            text.clear();
+        };
+        for (NodeId arg : ast.children(stmt)) {
+            if (ast[arg].kind == NodeKind::StringLiteral) {
+                text += ast[arg].text;
+                continue;
+            }
+            gen_text();
+            out << sep;
+            gen_operand(out, ast[arg]);
+            sep = ", ";
+        }
+        text += ending;
+        gen_text();
+        out << " });\n";
+        if (stmt.text == "\\n" && options.flush == FlushPolicy::Line) out << ind << "herlang::runtime::flush();\n";
+        break;
     }
-    else if (auto call = dynamic_cast<FunctionCall*>(stmt.get())) {
-        out << ind << call->name << "(";
+    case NodeKind::Flush:
+        out << ind << "herlang::runtime::flush();\n";
+        break;
+    case NodeKind::AwaitAll:
+        out << ind << "herlang_tasks.wait();\n";
+        break;
+    case NodeKind::Yield:
+        out << ind << "herlang::runtime::pause(" << stmt.text << ");\n";
+        break;
+    case NodeKind::Add:
+    case NodeKind::Minus:
+    case NodeKind::Multiply:
+    case NodeKind::Divide:
+        gen_arithmetic(out, ast, stmt, ind);
+        break;
+    case NodeKind::FunctionDef:
+        if (!stmt.text.empty()) {
+            // The argument may be text or a number, so the parameter takes
+            // its type from each call.
+            out << "template <typename herlang_T>\nvoid " << stmt.name << "(herlang_T " << stmt.text << ") {\n";
+        }
+        else {
+            out << "void " << stmt.name << "() {\n";
+        }
+
+        if (!gen_function_body(out, ast, stmt, options, calls, types, indent_level + 1) &&
+            options.flush == FlushPolicy::Block) {
+            out << indent(indent_level + 1) << "herlang::runtime::flush();\n";
+        }
+        out << "}\n";
+        break;
+    case NodeKind::FunctionCall: {
+        if (is_path(stmt.name)) {
+            // Folding recorded the record's type in the call's text.
+            out << ind << "herlang_" << stmt.text << "_" << path_member(stmt.name) << "(" << path_base(stmt.name) << ");\n";
+            break;
+        }
+        out << ind << stmt.name << "(";
+        ChildRange args = ast.children(stmt);
 #if _DEBUG
-        std::cerr << "[DEBUG] function call arg in gen " << escape_string(call->arg) << " ";
-        switch (call->arg_type) {
-        case TokenType::Keyword:        std::cerr << "Keyword    "; break;
-        case TokenType::Identifier:     std::cerr << "Identifier "; break;
-        case TokenType::StringLiteral:  std::cerr << "String     "; break;
-        case TokenType::Newline:        std::cerr << "Newline    "; break;
-        case TokenType::EOFToken:       std::cerr << "EOF        "; break;
-        case TokenType::Symbol:         std::cerr << "Symbol     "; break;
-        }
-        std::cerr << std::endl;
+        if (!args.empty()) {
+            const Node& arg = ast[args[0]];
+            std::cerr << "[DEBUG] function call arg in gen "
+                << (arg.kind == NodeKind::StringLiteral ? escape_string(arg.text) : std::string(arg.name)) << " "
+                << (arg.kind == NodeKind::StringLiteral ? "String     " : "Identifier ") << std::endl;
+        }
 #endif
-        if (!call->arg.empty()) {
-            if (call->arg_type == TokenType::StringLiteral) {
-                out << "\"" << escape_string(call->arg) << "\"";
-            }
-            else {
-                out << call->arg;
-            }
+        if (!args.empty()) {
+            gen_operand(out, ast[args[0]]);
         }
         out << ");\n";
+        break;
     }
-    else if (auto main = dynamic_cast<StartBlock*>(stmt.get())) {
-        out << "int main() {\n#ifdef _WIN32\nSetConsoleOutputCP(CP_UTF8);\n#endif\n\n";
-        for (auto& s : main->body) gen_stmt(out, s, indent_level + 1);
+    case NodeKind::StartBlock:
+        out << "int main() {\n" << indent(indent_level + 1) << "herlang::runtime::start();\n\n";
+        if (!gen_function_body(out, ast, stmt, options, calls, types, indent_level + 1)) {
+            out << indent(indent_level + 1) << "herlang::runtime::flush();\n";
+        }
         out << indent(indent_level + 1) << "return 0;\n";
         out << "}\n";
+        break;
+    default:
+        break;
     }
 }
 
-std::string generate_cpp(const AST& ast) {
-    std::ostringstream out;
-    out << "#include <iostream>\n#include <string>\n\n#ifdef _WIN32\n#include <windows.h>\n#endif\n\n";
+// A type with cases is a one-byte tag, the index of the case, followed by
+// a union of one struct per case, so every value has the same size and
+// its fields are stored inline. The union's constructors let a list of
+// values be a constant array.
+static void gen_cases(std::ostream& out, const RecordType& type) {
+    out << "struct " << type.name << " {\n";
+    for (const RecordCase& value : type.cases) {
+        out << "    struct herlang_" << value.name << " {";
+        for (const RecordField& field : value.fields) out << " " << element_type(field.type) << " " << field.name << ";";
+        out << (value.fields.empty() ? "};\n" : " };\n");
+    }
+    out << "    union herlang_payload {\n";
+    for (const RecordCase& value : type.cases) {
+        out << "        herlang_" << value.name << " " << value.name << ";\n";
+    }
+    for (const RecordCase& value : type.cases) {
+        out << "        constexpr herlang_payload(herlang_" << value.name << " v) : " << value.name << "(v) {}\n";
+    }
+    out << "    };\n\n";
+    out << "    unsigned char tag;\n";
+    out << "    herlang_payload payload;\n";
+    out << "};\n\n";
+}
+
+// A plain struct with the fields in declaration order, a struct of column
+// lists for a type stored as columns, and each method as a free function
+// named herlang_<Type>_<method>. Methods are declared first so they may
+// call each other in any order.
+static void gen_type(std::ostream& out, const AST& ast, const Node& def, const RecordType& type,
+    const CodegenOptions& options, const CallGraph* calls, const RecordTable& types) {
+    if (type.has_cases()) {
+        gen_cases(out, type);
+        return;
+    }
+    out << "struct " << type.name << " {\n";
+    for (const RecordField& field : type.fields) {
+        out << "    " << element_type(field.type) << " " << field.name << ";\n";
+    }
+    out << "};\n\n";
+
+    if (type.columns) {
+        out << "struct herlang_" << type.name << "_columns {\n";
+        for (const RecordField& field : type.fields) {
+            out << "    herlang::runtime::List<" << element_type(field.type) << "> " << field.name << ";\n";
+        }
+        out << "};\n\n";
+    }
+
+    if (type.methods.empty()) return;
+    for (const std::string& method : type.methods) {
+        out << "void herlang_" << type.name << "_" << method << "(" << type.name << " self);\n";
+    }
+    out << '\n';
+    for (NodeId id : ast.children(def)) {
+        const Node& method = ast[id];
+        if (method.kind != NodeKind::Method) continue;
+        out << "void herlang_" << type.name << "_" << method.name << "(" << type.name << " self) {\n";
+        if (!gen_function_body(out, ast, method, options, calls, types, 1) && options.flush == FlushPolicy::Block) {
+            out << indent(1) << "herlang::runtime::flush();\n";
+        }
+        out << "}\n\n";
+    }
+}
+
+void CppEmitter::begin() {
+    // Everything else lives in the prebuilt runtime library, libherlang_rt.
+    out_ << "#include \"herlang_rt.hpp\"\n\n";
+}
+
+void CppEmitter::emit(const AST& ast, NodeId stmt) {
+    switch (ast[stmt].kind) {
+    case NodeKind::TypeDef:
+        gen_type(out_, ast, ast[stmt], records_.add(ast, stmt), options_, calls_, records_);
+        break;
+    case NodeKind::FunctionDef:
+        if (calls_ && calls_->omitted.count(stmt)) break;
+        gen_stmt(out_, ast, stmt, options_, calls_, records_, 0);
+        out_ << '\n';
+        break;
+    case NodeKind::StartBlock:
+        // main() must follow every function it may call, so hold it back.
+        gen_stmt(held_, ast, stmt, options_, calls_, records_, 0);
+        held_ << '\n';
+        break;
+    default:
+        break;
+    }
+}
+
+void CppEmitter::finish() {
+    out_ << held_.str();
+    held_.str({});
+}
+
+// Functions are told apart by name and arity: `f` and `f x` become two
+// C++ overloads.
+using FunctionKey = std::pair<std::string_view, bool>;
+
+static FunctionKey call_key(const Node& call) { return { call.name, call.count != 0 }; }
 
-    for (auto& stmt : ast.statements) {
-        if (dynamic_cast<FunctionDef*>(stmt.get())) {
-            gen_stmt(out, stmt, 0);
-            out << '\n';
+// Bodies up to this many statements are worth copying into each caller.
+static constexpr uint32_t kMaxInlineStatements = 8;
+
+// A small leaf function whose every variable is its parameter or set in
+// its own body before use. Copying such a body into a caller cannot make a
+// name resolve to one of the caller's variables instead.
+static bool inlinable(const AST& ast, const Node& def) {
+    if (def.count > kMaxInlineStatements) return false;
+
+    std::vector<std::string_view> known;
+    if (!def.text.empty()) known.push_back(def.text);
+    auto is_known = [&](std::string_view name) {
+        return std::find(known.begin(), known.end(), name) != known.end();
+    };
+
+    for (NodeId id : ast.children(def)) {
+        const Node& stmt = ast[id];
+        switch (stmt.kind) {
+        case NodeKind::Say:
+            for (NodeId arg : ast.children(stmt)) {
+                if (ast[arg].kind == NodeKind::Variable && !is_known(ast[arg].name)) return false;
+            }
+            break;
+        case NodeKind::Set:
+            if (stmt.name == def.text) return false;
+            if (stmt.count) {
+                const Node& value = ast[ast.children(stmt)[0]];
+                if (value.kind == NodeKind::Variable && !is_known(value.name)) return false;
+            }
+            known.push_back(stmt.name);
+            break;
+        case NodeKind::Flush:
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+CallGraph analyze_calls(const AST& ast) {
+    std::map<FunctionKey, NodeId> defs;
+    std::vector<NodeId> work;
+    std::vector<NodeId> methods;
+    for (NodeId id : ast.statements) {
+        const Node& stmt = ast[id];
+        if (stmt.kind == NodeKind::FunctionDef) {
+            if (!defs.emplace(FunctionKey{ stmt.name, !stmt.text.empty() }, id).second) return {};
+        }
+        else if (stmt.kind == NodeKind::StartBlock) {
+            work.push_back(id);
+        }
+        else if (stmt.kind == NodeKind::TypeDef) {
+            for (NodeId member : ast.children(stmt)) {
+                if (ast[member].kind == NodeKind::Method) methods.push_back(member);
+            }
         }
     }
+    if (work.empty()) return {};
+    // Methods are always emitted, so what they call is reached too.
+    work.insert(work.end(), methods.begin(), methods.end());
 
-    for (auto& stmt : ast.statements) {
-        if (dynamic_cast<StartBlock*>(stmt.get())) {
-            gen_stmt(out, stmt, 0);
-            out << '\n';
+    // Walk every block reachable from a start block, deciding for each call
+    // on the way whether to inline it.
+    CallGraph graph;
+    std::unordered_set<NodeId> reached;
+    while (!work.empty()) {
+        NodeId block = work.back();
+        work.pop_back();
+        for (NodeId id : ast.children(block)) {
+            const Node& stmt = ast[id];
+            if (has_body(stmt.kind)) work.push_back(id);
+            if (stmt.kind != NodeKind::FunctionCall) continue;
+            auto it = defs.find(call_key(stmt));
+            if (it == defs.end()) continue;
+
+            NodeId def = it->second;
+            if (inlinable(ast, ast[def])) graph.inlined.emplace(id, def);
+            else if (reached.insert(def).second) work.push_back(def);
         }
     }
 
+    // Inlined functions are never called, so they go too.
+    for (const auto& entry : defs) {
+        if (!reached.count(entry.second)) graph.omitted.insert(entry.second);
+    }
+    return graph;
+}
+
+const char* flush_policy_name(FlushPolicy policy) {
+    switch (policy) {
+    case FlushPolicy::Line:  return "line";
+    case FlushPolicy::Block: return "block";
+    case FlushPolicy::Full:  return "full";
+    }
+    return "block";
+}
+
+bool parse_flush_policy(std::string_view name, FlushPolicy& policy) {
+    if (name == "line") policy = FlushPolicy::Line;
+    else if (name == "block") policy = FlushPolicy::Block;
+    else if (name == "full") policy = FlushPolicy::Full;
+    else return false;
+    return true;
+}
+
+void generate_cpp(const AST& ast, std::ostream& out, const CodegenOptions& options) {
+    CallGraph calls = analyze_calls(ast);
+    CppEmitter emitter(out, options, &calls);
+    emitter.begin();
+    for (NodeId stmt : ast.statements) emitter.emit(ast, stmt);
+    emitter.finish();
+}
+
+std::string generate_cpp(const AST& ast, const CodegenOptions& options) {
+    std::ostringstream out;
+    generate_cpp(ast, out, options);
     return out.str();
 }
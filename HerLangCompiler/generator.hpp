@@ -2,6 +2,71 @@
 #pragma once
 #include "ast.hpp"
 #include "lexer.hpp"
+#include "records.hpp"
+#include <ostream>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 
-std::string generate_cpp(const AST& ast);
\ No newline at end of file
+// When generated programs hand their buffered output to the OS. Output is
+// always flushed at exit, when the buffer fills and at 'flush' statements.
+enum class FlushPolicy {
+    Line,   // after every line, like std::endl
+    Block,  // when a function or the start block returns
+    Full,   // only when the buffer fills
+};
+
+struct CodegenOptions {
+    FlushPolicy flush = FlushPolicy::Block;
+    bool parallel_lists = true;   // split large list pipelines over the worker pool
+};
+
+const char* flush_policy_name(FlushPolicy policy);
+bool parse_flush_policy(std::string_view name, FlushPolicy& policy);
+
+// Whole-program call graph facts. Functions that no path from a start
+// block reaches are left out, and calls to small self-contained leaf
+// functions are replaced by a copy of the body, after which the function
+// itself is not emitted either.
+struct CallGraph {
+    std::unordered_set<NodeId> omitted;            // FunctionDefs not to emit
+    std::unordered_map<NodeId, NodeId> inlined;    // FunctionCall -> FunctionDef
+};
+
+// Left empty for programs without a start block or with two definitions of
+// the same function, so the C++ compiler sees and reports them unchanged.
+CallGraph analyze_calls(const AST& ast);
+
+// Writes a C++ translation unit one top-level statement at a time, so a
+// program can be generated while it is still being parsed. Functions are
+// written as soon as they are emitted; start blocks are held back and
+// written by finish(), after every function.
+//
+// With a CallGraph for the whole AST the emitter applies it; a streaming
+// caller that only ever sees part of the program passes none. A gentle_type
+// becomes a struct, plus a struct of column lists for `as columns`, and its
+// methods free functions taking a copy of the record; one with cases, a
+// tag and a union of the cases' fields. The emitter keeps the types it has
+// seen for the blocks that follow.
+class CppEmitter {
+public:
+    explicit CppEmitter(std::ostream& out, const CodegenOptions& options = {}, const CallGraph* calls = nullptr)
+        : out_(out), options_(options), calls_(calls) {}
+
+    void begin();
+    void emit(const AST& ast, NodeId stmt);
+    void finish();
+
+private:
+    std::ostream& out_;
+    CodegenOptions options_;
+    const CallGraph* calls_;
+    RecordTable records_;
+    std::ostringstream held_;
+};
+
+// Runs analyze_calls and emits the whole program.
+void generate_cpp(const AST& ast, std::ostream& out, const CodegenOptions& options = {});
+std::string generate_cpp(const AST& ast, const CodegenOptions& options = {});
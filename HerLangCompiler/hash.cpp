@@ -0,0 +1,101 @@
+// hash.cpp - Fast non-cryptographic hashing for cache keys
+#include "hash.hpp"
+#include <cstring>
+
+static constexpr uint64_t P1 = 11400714785074694791ULL;
+static constexpr uint64_t P2 = 14029467366897019727ULL;
+static constexpr uint64_t P3 = 1609587929392839161ULL;
+static constexpr uint64_t P4 = 9650029242287828579ULL;
+static constexpr uint64_t P5 = 2870177450012600261ULL;
+
+static uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static uint32_t read32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static uint64_t xx_round(uint64_t acc, uint64_t input) {
+    acc += input * P2;
+    acc = rotl(acc, 31);
+    return acc * P1;
+}
+
+static uint64_t merge_round(uint64_t acc, uint64_t val) {
+    acc ^= xx_round(0, val);
+    return acc * P1 + P4;
+}
+
+uint64_t hash64(std::string_view data, uint64_t seed) {
+    const char* p = data.data();
+    const char* end = p + data.size();
+    uint64_t h;
+
+    if (data.size() >= 32) {
+        uint64_t v1 = seed + P1 + P2;
+        uint64_t v2 = seed + P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - P1;
+        const char* limit = end - 32;
+        do {
+            v1 = xx_round(v1, read64(p));
+            v2 = xx_round(v2, read64(p + 8));
+            v3 = xx_round(v3, read64(p + 16));
+            v4 = xx_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge_round(h, v1);
+        h = merge_round(h, v2);
+        h = merge_round(h, v3);
+        h = merge_round(h, v4);
+    }
+    else {
+        h = seed + P5;
+    }
+
+    h += static_cast<uint64_t>(data.size());
+
+    while (p + 8 <= end) {
+        h ^= xx_round(0, read64(p));
+        h = rotl(h, 27) * P1 + P4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(read32(p)) * P1;
+        h = rotl(h, 23) * P2 + P3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= static_cast<uint64_t>(static_cast<unsigned char>(*p)) * P5;
+        h = rotl(h, 11) * P1;
+        ++p;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::string hash_hex(uint64_t h) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        out[i] = digits[h & 0xf];
+        h >>= 4;
+    }
+    return out;
+}
@@ -0,0 +1,12 @@
+// hash.hpp - Fast non-cryptographic hashing for cache keys
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// 64-bit XXH64 of `data`. Runs at several GB/s, so hashing a whole source
+// file is far cheaper than lexing it.
+uint64_t hash64(std::string_view data, uint64_t seed = 0);
+
+// Fixed-width lowercase hex, suitable for file names.
+std::string hash_hex(uint64_t h);
@@ -0,0 +1,232 @@
+// hbc.cpp - Precompiled bytecode files (.hbc) that execute in place
+#include "hbc.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static uint64_t align8(uint64_t n) {
+    return (n + 7) & ~uint64_t(7);
+}
+
+static uint32_t checked_offset(uint64_t n) {
+    if (n > UINT32_MAX) throw std::runtime_error("program too large for the .hbc format");
+    return static_cast<uint32_t>(n);
+}
+
+void write_hbc(const BytecodeProgram& program, std::ostream& out) {
+    HbcHeader header{};
+    std::memcpy(header.magic, kHbcMagic, sizeof header.magic);
+    header.version = kHbcVersion;
+    header.byte_order = kHbcByteOrder;
+    header.entry = program.entry;
+
+    uint64_t at = sizeof header;
+    header.code_offset = checked_offset(at);
+    header.code_size = checked_offset(program.code.size());
+    at = align8(at + program.code.size() * sizeof(Instr));
+    header.functions_offset = checked_offset(at);
+    header.function_count = checked_offset(program.functions.size());
+    at = align8(at + program.functions.size() * sizeof(BytecodeFunction));
+    header.constants_offset = checked_offset(at);
+    header.constant_count = checked_offset(program.constants.size());
+    at = align8(at + program.constants.size() * sizeof(BytecodeConstant));
+    header.strings_offset = checked_offset(at);
+    header.strings_size = checked_offset(program.strings.size());
+    header.file_size = checked_offset(at + program.strings.size());
+
+    static const char zeros[8] = {};
+    uint64_t written = 0;
+    auto put = [&](const void* data, size_t size) {
+        out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        written += size;
+        out.write(zeros, static_cast<std::streamsize>(align8(written) - written));
+        written = align8(written);
+    };
+    put(&header, sizeof header);
+    put(program.code.data(), program.code.size() * sizeof(Instr));
+    put(program.functions.data(), program.functions.size() * sizeof(BytecodeFunction));
+    put(program.constants.data(), program.constants.size() * sizeof(BytecodeConstant));
+    out.write(program.strings.data(), static_cast<std::streamsize>(program.strings.size()));
+}
+
+template <typename T>
+static const T* section(std::string_view image, uint32_t offset, uint32_t count, const char* what) {
+    if (offset % alignof(T) != 0 || offset > image.size() ||
+        uint64_t(count) * sizeof(T) > image.size() - offset) {
+        throw std::runtime_error(std::string("corrupt .hbc file: bad ") + what + " section");
+    }
+    return reinterpret_cast<const T*>(image.data() + offset);
+}
+
+// The source and every operand of a Pipeline must be registers of the
+// function or constants that exist, and every stage one the VM knows.
+static bool valid_pipeline(const BytecodeView& p, const BytecodeConstant& c, uint32_t registers) {
+    if (c.size < sizeof(uint32_t) + sizeof(PipelineStage) || (c.size - sizeof(uint32_t)) % sizeof(PipelineStage) != 0) {
+        return false;
+    }
+    const char* data = p.strings + c.offset;
+    uint32_t source;
+    std::memcpy(&source, data, sizeof source);
+    if (source >= registers) return false;
+
+    for (uint32_t at = sizeof source; at < c.size; at += sizeof(PipelineStage)) {
+        PipelineStage stage;
+        std::memcpy(&stage, data + at, sizeof stage);
+        if (stage.op >= StageOp::Count || stage.type > NumType::Float) return false;
+        switch (stage.operand) {
+        case StageOperand::Register: if (stage.index >= registers) return false; break;
+        case StageOperand::Element:  break;
+        case StageOperand::Text:     if (stage.index >= p.constant_count) return false; break;
+        default:                     return false;
+        }
+    }
+    return true;
+}
+
+// Everything the VM relies on without checking at run time.
+static void verify(const BytecodeView& p) {
+    auto bad = [](const std::string& what) {
+        return std::runtime_error("corrupt .hbc file: " + what);
+    };
+
+    for (uint32_t i = 0; i < p.constant_count; ++i) {
+        const BytecodeConstant& c = p.constants[i];
+        if (c.offset > p.strings_size || c.size > p.strings_size - c.offset) {
+            throw bad("constant " + std::to_string(i) + " is outside the string pool");
+        }
+    }
+
+    if (p.entry >= p.function_count || p.functions[p.entry].params != 0) throw bad("bad entry function");
+
+    // Each function owns the code from its entry up to the next function's,
+    // and must end in a Return so execution cannot run into its neighbour.
+    std::vector<uint32_t> order(p.function_count);
+    for (uint32_t i = 0; i < p.function_count; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) {
+        return p.functions[x].entry < p.functions[y].entry;
+    });
+    if (p.code_size != 0 && (order.empty() || p.functions[order[0]].entry != 0)) {
+        throw bad("code outside any function");
+    }
+
+    for (size_t k = 0; k < order.size(); ++k) {
+        const BytecodeFunction& fn = p.functions[order[k]];
+        uint32_t end = k + 1 < order.size() ? p.functions[order[k + 1]].entry : p.code_size;
+        std::string where = "function " + std::to_string(order[k]);
+        if (fn.params > fn.registers) throw bad(where + " has bad parameters");
+        if (fn.entry >= end || end > p.code_size || p.code[end - 1].op != Op::Return) {
+            throw bad(where + " does not end in a return");
+        }
+
+        for (uint32_t pc = fn.entry; pc < end; ++pc) {
+            const Instr& in = p.code[pc];
+            bool ok = false;
+            switch (in.op) {
+            case Op::LoadInt:
+            case Op::Print:
+                ok = in.a < fn.registers;
+                break;
+            case Op::LoadStr:
+                ok = in.a < fn.registers && in.b < p.constant_count;
+                break;
+            case Op::LoadI64:
+            case Op::LoadF64:
+                ok = in.a < fn.registers && in.b < p.constant_count && p.constants[in.b].size == 8;
+                break;
+            case Op::Move:
+            case Op::ToFloat:
+            case Op::AddI:
+            case Op::SubI:
+            case Op::MulI:
+            case Op::DivI:
+            case Op::AddF:
+            case Op::SubF:
+            case Op::MulF:
+            case Op::DivF:
+                ok = in.a < fn.registers && in.b < fn.registers;
+                break;
+            case Op::PrintStr:
+                ok = in.b < p.constant_count;
+                break;
+            case Op::ListStr:
+                ok = in.a < fn.registers && in.b < p.constant_count && p.constants[in.b].size % 4 == 0;
+                for (uint32_t i = 0; ok && i < p.constants[in.b].size / 4; ++i) {
+                    uint32_t k;
+                    std::memcpy(&k, p.strings + p.constants[in.b].offset + i * 4, sizeof k);
+                    ok = k < p.constant_count;
+                }
+                break;
+            case Op::ListI64:
+            case Op::ListF64:
+                ok = in.a < fn.registers && in.b < p.constant_count && p.constants[in.b].size % 8 == 0;
+                break;
+            case Op::Pipeline:
+                ok = in.a < fn.registers && in.b < p.constant_count && valid_pipeline(p, p.constants[in.b], fn.registers);
+                break;
+            case Op::Next:
+                ok = in.a + 2u < fn.registers && in.b >= fn.entry && in.b < end;
+                break;
+            case Op::Jump:
+                ok = in.b >= fn.entry && in.b < end;
+                break;
+            case Op::Switch:
+                ok = in.a < fn.registers && in.b < p.constant_count && p.constants[in.b].size % 4 == 0;
+                for (uint32_t i = 0; ok && i < p.constants[in.b].size / 4; ++i) {
+                    uint32_t target;
+                    std::memcpy(&target, p.strings + p.constants[in.b].offset + i * 4, sizeof target);
+                    ok = target >= fn.entry && target < end;
+                }
+                break;
+            case Op::Loop:
+                ok = in.a < fn.registers && in.b >= fn.entry && in.b < end;
+                break;
+            case Op::Flush:
+            case Op::Sleep:
+            case Op::Return:
+                ok = true;
+                break;
+            case Op::Call:
+                ok = in.b < p.function_count &&
+                    (p.functions[in.b].params ? uint32_t{ in.a } + p.functions[in.b].params <= fn.registers
+                                              : in.a == kNoRegister);
+                break;
+            }
+            if (!ok) throw bad(where + " has a bad instruction at " + std::to_string(pc));
+        }
+    }
+}
+
+BytecodeView load_hbc(std::string_view image) {
+    if (reinterpret_cast<uintptr_t>(image.data()) % 8 != 0) {
+        throw std::runtime_error(".hbc image is not 8-byte aligned");
+    }
+    if (image.size() < sizeof(HbcHeader) || std::memcmp(image.data(), kHbcMagic, sizeof kHbcMagic) != 0) {
+        throw std::runtime_error("not an .hbc file");
+    }
+
+    const auto& h = *reinterpret_cast<const HbcHeader*>(image.data());
+    if (h.byte_order != kHbcByteOrder) {
+        throw std::runtime_error(".hbc file was written on a machine with a different byte order");
+    }
+    if (h.version != kHbcVersion) {
+        throw std::runtime_error(".hbc format version " + std::to_string(h.version) + " is not supported (expected " +
+            std::to_string(kHbcVersion) + "); recompile it with this hcp");
+    }
+    if (h.file_size != image.size()) throw std::runtime_error("corrupt .hbc file: truncated or padded");
+
+    BytecodeView view;
+    view.code = section<Instr>(image, h.code_offset, h.code_size, "code");
+    view.code_size = h.code_size;
+    view.functions = section<BytecodeFunction>(image, h.functions_offset, h.function_count, "function");
+    view.function_count = h.function_count;
+    view.constants = section<BytecodeConstant>(image, h.constants_offset, h.constant_count, "constant");
+    view.constant_count = h.constant_count;
+    view.strings = section<char>(image, h.strings_offset, h.strings_size, "string");
+    view.strings_size = h.strings_size;
+    view.entry = h.entry;
+
+    verify(view);
+    return view;
+}
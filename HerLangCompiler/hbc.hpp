@@ -0,0 +1,47 @@
+// hbc.hpp - Precompiled bytecode files (.hbc) that execute in place
+#pragma once
+#include "bytecode.hpp"
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+// Bump whenever the layout below or the meaning of any opcode changes.
+constexpr uint32_t kHbcVersion = 8;
+
+// An .hbc file is this header followed by the code, function table and
+// constant table of a BytecodeProgram, each 8-byte aligned, and then the
+// string pool. Offsets are from the start of the file and nothing refers to
+// an absolute address, so a mapped file is executed without being copied
+// or relocated. Values use the byte order of the machine that wrote them;
+// other machines reject the file rather than swapping.
+struct HbcHeader {
+    char magic[8];            // kHbcMagic
+    uint32_t version;         // kHbcVersion
+    uint32_t byte_order;      // kHbcByteOrder as stored by the writer
+    uint32_t entry;
+    uint32_t code_offset;
+    uint32_t code_size;       // instructions
+    uint32_t functions_offset;
+    uint32_t function_count;
+    uint32_t constants_offset;
+    uint32_t constant_count;
+    uint32_t strings_offset;
+    uint32_t strings_size;    // bytes
+    uint32_t file_size;
+    uint32_t reserved[2];
+};
+static_assert(sizeof(HbcHeader) == 64, "the .hbc header is 64 bytes");
+
+// Non-ASCII first byte and a CR LF / ^Z / LF tail, as in PNG, so text-mode
+// transfers and truncated copies are caught by the magic check.
+constexpr char kHbcMagic[8] = { '\x89', 'H', 'B', 'C', '\r', '\n', '\x1a', '\n' };
+constexpr uint32_t kHbcByteOrder = 0x01020304;
+
+void write_hbc(const BytecodeProgram& program, std::ostream& out);
+
+// Checks that `image` (normally a MappedFile view, which is page aligned)
+// is a complete .hbc file of this version and that every instruction only
+// refers to registers, constants and functions that exist, then returns a
+// view straight into it. The image must outlive the view. Throws
+// std::runtime_error saying what is wrong otherwise.
+BytecodeView load_hbc(std::string_view image);
@@ -0,0 +1,176 @@
+// keywords.hpp - Compile-time perfect-hash keyword table
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// The single list of HerLang keywords, shared by the lexer, the indentation
+// checker and the herlang build tool. Aliases ("gentle_function") map to the
+// same ID as the word they stand for.
+enum class Keyword : uint8_t {
+    None,
+    Function,
+    Start,
+    End,
+    If,
+    Elif,
+    Else,
+    Say,
+    Set,
+    Add,
+    Minus,
+    Multiply,
+    Divide,
+    Flush,
+    Repeat,
+    List,
+    For,
+    Spawn,
+    AwaitAll,
+    Yield,
+    Type,
+    Method,
+    Match,
+};
+
+enum KeywordFlags : uint8_t {
+    OpensBlock = 1 << 0,      // a line starting with it is closed by 'end'
+    ContinuesBlock = 1 << 1,  // another arm of the enclosing block (elif, else)
+    ClosesBlock = 1 << 2,     // 'end'
+};
+
+struct KeywordInfo {
+    std::string_view spelling;
+    Keyword id;
+    uint8_t flags;
+};
+
+inline constexpr KeywordInfo keyword_list[] = {
+    { "function",        Keyword::Function, OpensBlock },
+    { "gentle_function", Keyword::Function, OpensBlock },
+    { "start",           Keyword::Start,    OpensBlock },
+    { "end",             Keyword::End,      ClosesBlock },
+    { "if",              Keyword::If,       OpensBlock },
+    { "gently_if",       Keyword::If,       OpensBlock },
+    { "elif",            Keyword::Elif,     ContinuesBlock },
+    { "else",            Keyword::Else,     ContinuesBlock },
+    { "say",             Keyword::Say,      0 },
+    { "set",             Keyword::Set,      0 },
+    { "add",             Keyword::Add,      0 },
+    { "minus",           Keyword::Minus,    0 },
+    { "multiply",        Keyword::Multiply, 0 },
+    { "divide",          Keyword::Divide,   0 },
+    { "flush",           Keyword::Flush,    0 },
+    { "repeat",          Keyword::Repeat,   OpensBlock },
+    { "gentle_list",     Keyword::List,     0 },
+    { "gently_for",      Keyword::For,      OpensBlock },
+    { "spawn_gently",    Keyword::Spawn,    OpensBlock },
+    { "await_all_with_patience", Keyword::AwaitAll, 0 },
+    { "yield_kindly",    Keyword::Yield,    0 },
+    { "gentle_type",     Keyword::Type,     OpensBlock },
+    { "gentle_method",   Keyword::Method,   OpensBlock },
+    { "match_gently",    Keyword::Match,    OpensBlock },
+};
+
+namespace keyword_detail {
+
+constexpr size_t table_size = 128; // power of two, well above the keyword count
+constexpr size_t keyword_count = sizeof keyword_list / sizeof keyword_list[0];
+
+// Looks at the length and three characters only, so hashing a word costs the
+// same whatever its length. Words this cannot tell apart would make
+// find_seed() fail at compile time.
+constexpr uint32_t hash(std::string_view word, uint32_t seed) {
+    uint32_t h = seed ^ static_cast<uint32_t>(word.size());
+    h = (h ^ static_cast<unsigned char>(word[0])) * 0x01000193u;
+    h = (h ^ static_cast<unsigned char>(word[word.size() / 2])) * 0x01000193u;
+    h = (h ^ static_cast<unsigned char>(word[word.size() - 1])) * 0x01000193u;
+    return (h ^ (h >> 15)) & (table_size - 1);
+}
+
+constexpr bool collides(uint32_t seed) {
+    std::array<bool, table_size> used{};
+    for (const auto& kw : keyword_list) {
+        uint32_t slot = hash(kw.spelling, seed);
+        if (used[slot]) return true;
+        used[slot] = true;
+    }
+    return false;
+}
+
+constexpr uint32_t find_seed() {
+    for (uint32_t seed = 1; seed < 100000; ++seed) {
+        if (!collides(seed)) return seed;
+    }
+    return 0;
+}
+
+constexpr uint32_t seed = find_seed();
+static_assert(seed != 0, "no collision-free seed for the keyword table; grow table_size");
+
+// Slot -> index into keyword_list, or 0xFF for an empty slot.
+constexpr std::array<uint8_t, table_size> build_slots() {
+    std::array<uint8_t, table_size> slots{};
+    for (auto& s : slots) s = 0xFF;
+    for (size_t i = 0; i < keyword_count; ++i) {
+        slots[hash(keyword_list[i].spelling, seed)] = static_cast<uint8_t>(i);
+    }
+    return slots;
+}
+
+constexpr std::array<uint8_t, table_size> slots = build_slots();
+
+constexpr size_t min_length() {
+    size_t n = keyword_list[0].spelling.size();
+    for (const auto& kw : keyword_list) n = kw.spelling.size() < n ? kw.spelling.size() : n;
+    return n;
+}
+
+constexpr size_t max_length() {
+    size_t n = 0;
+    for (const auto& kw : keyword_list) n = kw.spelling.size() > n ? kw.spelling.size() : n;
+    return n;
+}
+
+} // namespace keyword_detail
+
+// Classifies `word` with one hash and one comparison. Returns nullptr for
+// anything that is not a keyword.
+constexpr const KeywordInfo* find_keyword(std::string_view word) {
+    using namespace keyword_detail;
+    if (word.size() < min_length() || word.size() > max_length()) return nullptr;
+    uint8_t index = slots[hash(word, seed)];
+    if (index == 0xFF || keyword_list[index].spelling != word) return nullptr;
+    return &keyword_list[index];
+}
+
+constexpr Keyword keyword_id(std::string_view word) {
+    const KeywordInfo* kw = find_keyword(word);
+    return kw ? kw->id : Keyword::None;
+}
+
+constexpr uint8_t keyword_flags(std::string_view word) {
+    const KeywordInfo* kw = find_keyword(word);
+    return kw ? kw->flags : 0;
+}
+
+// The keyword a (trimmed) source line starts with, if any: "start:" and
+// "say \"hi\"" both qualify, "functional" does not.
+constexpr const KeywordInfo* leading_keyword(std::string_view line) {
+    size_t n = 0;
+    while (n < line.size()) {
+        char c = line[n];
+        bool word_char = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') || c == '_';
+        if (!word_char) break;
+        ++n;
+    }
+    return find_keyword(line.substr(0, n));
+}
+
+static_assert(keyword_id("function") == Keyword::Function);
+static_assert(keyword_id("gentle_function") == Keyword::Function);
+static_assert(keyword_id("divide") == Keyword::Divide);
+static_assert(keyword_id("functio") == Keyword::None);
+static_assert(keyword_id("start_") == Keyword::None);
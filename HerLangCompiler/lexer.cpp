@@ -1,64 +1,123 @@
 // lexer.cpp - MyLang lexer implementation
 #include "lexer.hpp"
 #include "utils.hpp"
-#include <regex>
-#include <sstream>
+#include "warnings.hpp"
+#include <stdexcept>
 #include <cctype>
 
-std::vector<Token> lex(const std::vector<std::string>& lines) {
-    std::vector<Token> tokens;
-    std::regex string_regex("\"(.*?)\"");
+static bool is_ident_start(char c) {
+    return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
 
-    for (int i = 0; i < lines.size(); ++i) {
-        std::string line = trim(lines[i]);
-        if (line.empty() || line[0] == '#') continue;
+static bool is_ident_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
 
-        size_t j = 0;
-        while (j < line.size()) {
-            if (std::isspace(line[j])) {
-                ++j;
-                continue;
-            }
+// "->" in a pipeline stage and the comparisons it may use.
+static bool is_two_char_symbol(std::string_view s) {
+    return s == "->" || s == "<=" || s == ">=" || s == "==" || s == "!=";
+}
 
-            if (line[j] == '"') {
-                // Parse string literal
-                size_t end = line.find('"', j + 1);
-                if (end == std::string::npos) {
-                    throw std::runtime_error("Unterminated string at line " + std::to_string(i + 1));
-                }
-                std::string str = line.substr(j + 1, end - j - 1);
-                tokens.push_back({ TokenType::StringLiteral, str, i + 1 });
-                j = end + 1;
-            }
-            else if (std::isalpha(line[j]) || line[j] == '_') {
-                // Identifier or keyword
-                size_t start = j;
-                while (j < line.size() && (std::isalnum(line[j]) || line[j] == '_')) ++j;
-                std::string word = line.substr(start, j - start);
-
-                if (word == "function" || word == "start" || word == "end" ||
-                    word == "if" || word == "elif" || word == "else" ||
-                    word == "say" || word == "set" ||
-                    word == "add" || word == "minus" ||
-                    word == "multiply" || word == "divide") {
-                    tokens.push_back({ TokenType::Keyword, word, i + 1 });
-                }
-                else {
-                    tokens.push_back({ TokenType::Identifier, word, i + 1 });
-                }
-            }
-            else if (line[j] == ':' || line[j] == '=' || line[j] == '(' || line[j] == ')') {
-                // Symbols
-                tokens.push_back({ TokenType::Symbol, std::string(1, line[j]), i + 1 });
-                ++j;
+// Lexes one raw source line; `raw` must outlive the produced tokens.
+static void lex_line(std::string_view raw, int lineno, std::vector<Token>& tokens, IndentationChecker* indent) {
+    // Trim and measure the indent (leading spaces) in the same scan.
+    size_t begin = 0;
+    int spaces = 0;
+    bool counting = true;
+    while (begin < raw.size() && std::isspace(static_cast<unsigned char>(raw[begin]))) {
+        if (counting && raw[begin] == ' ') ++spaces;
+        else counting = false;
+        ++begin;
+    }
+    size_t end = raw.size();
+    while (end > begin && std::isspace(static_cast<unsigned char>(raw[end - 1]))) --end;
+
+    std::string_view line = raw.substr(begin, end - begin);
+    if (line.empty() || line[0] == '#') return;
+    if (indent) indent->line(lineno, spaces, line);
+
+    size_t j = 0;
+    while (j < line.size()) {
+        if (std::isspace(static_cast<unsigned char>(line[j]))) {
+            ++j;
+            continue;
+        }
+
+        if (line[j] == '"') {
+            // Parse string literal
+            size_t end = line.find('"', j + 1);
+            if (end == std::string_view::npos) {
+                throw std::runtime_error("Unterminated string at line " + std::to_string(lineno));
             }
-            else {
-                // Unexpected character, skip or report
+            tokens.push_back({ TokenType::StringLiteral, line.substr(j + 1, end - j - 1), lineno });
+            j = end + 1;
+        }
+        else if (std::isdigit(static_cast<unsigned char>(line[j])) ||
+            (line[j] == '-' && j + 1 < line.size() && std::isdigit(static_cast<unsigned char>(line[j + 1])))) {
+            // Number: optional '-', digits, optional fraction
+            size_t start = j++;
+            while (j < line.size() && std::isdigit(static_cast<unsigned char>(line[j]))) ++j;
+            if (j + 1 < line.size() && line[j] == '.' && std::isdigit(static_cast<unsigned char>(line[j + 1]))) {
                 ++j;
+                while (j < line.size() && std::isdigit(static_cast<unsigned char>(line[j]))) ++j;
             }
+            tokens.push_back({ TokenType::Number, line.substr(start, j - start), lineno });
+        }
+        else if (is_ident_start(line[j])) {
+            // Identifier or keyword
+            size_t start = j;
+            while (j < line.size() && is_ident_char(line[j])) ++j;
+            std::string_view word = line.substr(start, j - start);
+
+            Keyword kw = keyword_id(word);
+            tokens.push_back({ kw != Keyword::None ? TokenType::Keyword : TokenType::Identifier, word, lineno, kw });
+        }
+        else if (j + 1 < line.size() && is_two_char_symbol(line.substr(j, 2))) {
+            tokens.push_back({ TokenType::Symbol, line.substr(j, 2), lineno });
+            j += 2;
         }
+        else if (std::string_view(":=()[],.+-*/<>").find(line[j]) != std::string_view::npos) {
+            // Symbols
+            tokens.push_back({ TokenType::Symbol, line.substr(j, 1), lineno });
+            ++j;
+        }
+        else {
+            // Unexpected character, skip or report
+            ++j;
+        }
+    }
+
+    tokens.push_back({ TokenType::Newline, "\\n", lineno });
+}
+
+bool Lexer::lex_line(std::vector<Token>& tokens) {
+    std::string_view line;
+    if (!next_line(source_, pos_, line)) {
+        if (indent_) {
+            indent_->finish();
+            indent_ = nullptr;
+        }
+        return false;
+    }
+    ::lex_line(line, ++line_, tokens, indent_);
+    return true;
+}
+
+std::vector<Token> lex(std::string_view source, IndentationChecker* indent) {
+    std::vector<Token> tokens;
+
+    Lexer lexer(source, indent);
+    while (lexer.lex_line(tokens)) {}
+
+    tokens.push_back(lexer.eof());
+    return tokens;
+}
+
+std::vector<Token> lex(const std::vector<std::string>& lines) {
+    std::vector<Token> tokens;
 
-        tokens.push_back({ TokenType::Newline, "\\n", i + 1 });
+    for (size_t i = 0; i < lines.size(); ++i) {
+        lex_line(lines[i], (int)i + 1, tokens, nullptr);
     }
 
     tokens.push_back({ TokenType::EOFToken, "", (int)lines.size() });
@@ -1,14 +1,16 @@
 // lexer.hpp - MyLang lexer interface
 #pragma once
+#include "keywords.hpp"
 #include <vector>
 #include <string>
-#include <sstream>
+#include <string_view>
 
 
 enum class TokenType {
     Keyword,
     Identifier,
     StringLiteral,
+    Number,
     Symbol,
     Indent,
     Dedent,
@@ -17,10 +19,42 @@ enum class TokenType {
     Unknown
 };
 
+class IndentationChecker;
+
+// Token values are views into the lexed source (or into static storage for
+// synthesized tokens), so the source must outlive the token stream.
 struct Token {
     TokenType type;
-    std::string value;
+    std::string_view value;
     int line;
+    Keyword kw = Keyword::None;  // set for TokenType::Keyword
+};
+
+// Incremental form of lex(std::string_view): yields one source line at a
+// time so a caller can hand complete blocks to the parser while the rest of
+// the file is still unread.
+//
+// When given an IndentationChecker, the lexer reports every line's indent
+// to it from the same scan, and finishes it at end of input.
+class Lexer {
+public:
+    explicit Lexer(std::string_view source, IndentationChecker* indent = nullptr)
+        : source_(source), indent_(indent) {}
+
+    // Appends the tokens of the next line (nothing for blank or comment
+    // lines). Returns false once the source is exhausted.
+    bool lex_line(std::vector<Token>& tokens);
+    Token eof() const { return { TokenType::EOFToken, "", line_ }; }
+    int line() const { return line_; }
+
+private:
+    std::string_view source_;
+    IndentationChecker* indent_;
+    size_t pos_ = 0;
+    int line_ = 0;
 };
 
+// Single pass over a whole source buffer (typically a MappedFile view).
+// Tokens never own memory; the only allocation is the token vector itself.
+std::vector<Token> lex(std::string_view source, IndentationChecker* indent = nullptr);
 std::vector<Token> lex(const std::vector<std::string>& lines);
@@ -1,85 +1,278 @@
 // main.cpp - Entry point for MyLangCompiler
-#include "lexer.hpp"
-#include "parser.hpp"
-#include "generator.hpp"
-#include "warnings.hpp"
-#include "utils.hpp"
+#include "driver.hpp"
+#include "hbc.hpp"
+#include "mapped_file.hpp"
+#include "stats.hpp"
+#include "vm.hpp"
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
 
-int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: hcp in.herc out.cpp\n";
-        return 1;
+namespace fs = std::filesystem;
+
+static void print_usage() {
+    std::cerr << "Usage: hcp in.herc out.cpp\n"
+        << "       hcp [options] in1.herc in2.herc ...\n"
+        << "       hcp in.herc out.hbc\n"
+        << "       hcp --run [options] in.herc|in.hbc\n"
+        << "\n"
+        << "  --run             execute a program on the bytecode VM instead of writing C++\n"
+        << "  --emit=cpp|hbc    write C++ (default) or precompiled bytecode for --run\n"
+        << "  -j N              compile with N worker threads (default: all cores)\n"
+        << "  -o outdir         write <name>.cpp (or .hbc) for every input into outdir\n"
+        << "                    (default: next to each input)\n"
+        << "  --files list.txt  read additional inputs from list.txt, one per line\n"
+        << "  --cache dir       reuse generated C++ for unchanged sources\n"
+        << "                    (default: $HERLANG_CACHE_DIR, if set)\n"
+        << "  --no-cache        ignore $HERLANG_CACHE_DIR\n"
+        << "  --stream          lex, parse and emit one top-level block at a time\n"
+        << "                    (bounded memory for very large inputs)\n"
+        << "  --time-passes     report time, sizes and memory per compiler pass\n"
+        << "  --time-passes=json\n"
+        << "                    the same report as a single JSON object\n"
+        << "  --stats-file f    also write the JSON report to f\n"
+        << "  --flush=line|block|full\n"
+        << "                    when generated programs flush their output buffer\n"
+        << "                    (default: block, when a function returns)\n"
+        << "  --no-parallel-lists\n"
+        << "                    fill lists made by filter_gently/transform_kindly on\n"
+        << "                    one thread, however long they are\n";
+}
+
+static bool write_stats(const CompileStats& total, double start_wall, bool console, bool json,
+    const std::string& stats_file) {
+    double wall = wall_seconds() - start_wall;
+    double cpu = process_cpu_seconds();
+    if (console) report_stats(std::cerr, total, wall, cpu, json);
+    if (!stats_file.empty()) {
+        std::ofstream out(stats_file);
+        if (!out) {
+            std::cerr << "Cannot write stats file: " << stats_file << "\n";
+            return false;
+        }
+        report_stats(out, total, wall, cpu, true);
+    }
+    return true;
+}
+
+// hcp --run: execute a .hbc file in place, or compile a .herc file to
+// bytecode first. Either way no C++ toolchain is involved.
+static int run(const std::string& input, const CompileOptions& options, double start_wall,
+    bool stats_console, bool stats_json, const std::string& stats_file) {
+    BytecodeProgram compiled;
+    MappedFile image;
+    BytecodeView program;
+    CompileResult result;
+
+    if (fs::path(input).extension() == ".hbc") {
+        PassTimer read_timer(options.time_passes ? &result.stats : nullptr, Pass::Read);
+        if (!image.open(input)) {
+            std::cerr << "Cannot open input file: " << input << "\n";
+            return 1;
+        }
+        try {
+            program = load_hbc(image.view());
+        }
+        catch (const std::exception& e) {
+            std::cerr << "[Error] " << input << ": " << e.what() << "\n";
+            return 1;
+        }
+        result.stats.files = 1;
+        result.stats.bytes_in = image.view().size();
+    }
+    else {
+        result = compile_to_bytecode(input, compiled, options);
+        std::cerr << result.diagnostics;
+        if (!result.ok) return 1;
+        program = compiled.view();
+    }
+
+    int status = 0;
+    try {
+        run_bytecode(program);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "[Error] " << input << ": " << e.what() << "\n";
+        status = 1;
     }
 
-    std::ifstream input(argv[1]);
-    if (!input) {
-        std::cerr << "Cannot open input file: " << argv[1] << "\n";
+    if (options.time_passes && !write_stats(result.stats, start_wall, stats_console, stats_json, stats_file)) {
         return 1;
     }
+    return status;
+}
+
+static bool read_file_list(const std::string& path, std::vector<std::string>& inputs) {
+    std::ifstream list(path);
+    if (!list) return false;
+
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) inputs.push_back(line);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    double start_wall = wall_seconds();
+    std::vector<std::string> inputs;
+    std::string out_dir;
+    bool have_out_dir = false;
+    unsigned threads = std::thread::hardware_concurrency();
+    CompileOptions options;
+    bool stats_console = false;
+    bool stats_json = false;
+    std::string stats_file;
+    bool run_mode = false;
+    if (const char* env = std::getenv("HERLANG_CACHE_DIR")) options.cache_dir = env;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-j" || arg == "-o" || arg == "--files" || arg == "--cache" || arg == "--stats-file") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << "\n";
+                print_usage();
+                return 1;
+            }
+            std::string value = argv[++i];
+            if (arg == "-j") {
+                threads = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+            }
+            else if (arg == "-o") {
+                out_dir = value;
+                have_out_dir = true;
+            }
+            else if (arg == "--cache") {
+                options.cache_dir = value;
+            }
+            else if (arg == "--stats-file") {
+                stats_file = value;
+                options.time_passes = true;
+            }
+            else if (!read_file_list(value, inputs)) {
+                std::cerr << "Cannot open file list: " << value << "\n";
+                return 1;
+            }
+        }
+        else if (arg.size() > 2 && arg.compare(0, 2, "-j") == 0) {
+            threads = static_cast<unsigned>(std::strtoul(arg.c_str() + 2, nullptr, 10));
+        }
+        else if (arg == "--time-passes" || arg == "--time-passes=json") {
+            options.time_passes = true;
+            stats_console = true;
+            stats_json = arg == "--time-passes=json";
+        }
+        else if (arg.compare(0, 8, "--flush=") == 0) {
+            if (!parse_flush_policy(std::string_view(arg).substr(8), options.codegen.flush)) {
+                std::cerr << "Unknown flush policy: " << arg.substr(8) << "\n";
+                print_usage();
+                return 1;
+            }
+        }
+        else if (arg == "--emit=cpp" || arg == "--emit=hbc") {
+            options.output = arg == "--emit=hbc" ? OutputKind::Bytecode : OutputKind::Cpp;
+        }
+        else if (arg == "--run") {
+            run_mode = true;
+        }
+        else if (arg == "--stream") {
+            options.stream = true;
+        }
+        else if (arg == "--no-cache") {
+            options.cache_dir.clear();
+        }
+        else if (arg == "--no-parallel-lists") {
+            options.codegen.parallel_lists = false;
+        }
+        else if (arg == "-h" || arg == "--help") {
+            print_usage();
+            return 0;
+        }
+        else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << "\n";
+            print_usage();
+            return 1;
+        }
+        else {
+            inputs.push_back(arg);
+        }
+    }
 
-    std::string source((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
-    input.close();
-
-    check_indentation(source); // Check for indentation warnings
-
-    auto lines = split_lines(source);
-    auto tokens = lex(lines);
-#if _DEBUG
-    std::cerr << "=== Tokens ===\n";
-    for (const auto& tok : tokens) {
-        std::cerr << "[" << tok.line << "] ";
-        switch (tok.type) {
-        case TokenType::Keyword:        std::cerr << "Keyword    "; break;
-        case TokenType::Identifier:     std::cerr << "Identifier "; break;
-        case TokenType::StringLiteral:  std::cerr << "String     "; break;
-        case TokenType::Newline:        std::cerr << "Newline    "; break;
-        case TokenType::EOFToken:       std::cerr << "EOF        "; break;
-        case TokenType::Symbol:         std::cerr << "Symbol     "; break;
-        }
-        std::cerr << ": " << tok.value << "\n";
+    if (run_mode) {
+        if (inputs.size() != 1) {
+            std::cerr << "--run takes exactly one input file\n";
+            print_usage();
+            return 1;
+        }
+        return run(inputs[0], options, start_wall, stats_console, stats_json, stats_file);
+    }
+
+    std::vector<CompileJob> jobs;
+    if (!have_out_dir && inputs.size() == 2 && fs::path(inputs[1]).extension() != ".herc") {
+        // Classic form: hcp in.herc out.cpp (or out.hbc)
+        if (fs::path(inputs[1]).extension() == ".hbc") options.output = OutputKind::Bytecode;
+        jobs.push_back({ inputs[0], inputs[1] });
     }
-    std::cerr << "==============\n";
-
-#endif
-    auto ast = parse(tokens);
-#if _DEBUG
-    std::cerr << "=== AST ===\n";
-    for (const auto& stmt : ast.statements) {
-        if (auto func = std::dynamic_pointer_cast<FunctionDef>(stmt)) {
-            std::cerr << "Function: " << func->name << "(" << func->param << "), body size = " << func->body.size() << "\n";
-            for (auto& inner : func->body) {
-                if (auto say = std::dynamic_pointer_cast<SayStatement>(inner)) {
-                    std::cerr << "  Say: ";
-                    for (size_t i = 0; i < say->args.size(); ++i) {
-                        if (say->is_vars[i]) {
-                            std::cerr << "VAR(" << say->args[i] << ") ";
-                        }
-                        else {
-                            std::cerr << "\"" << say->args[i] << "\" ";
-                        }
-                    }
-                    std::cerr << "ending = \"" << say->end << "\"\n";
-                }
+    else {
+        if (have_out_dir) {
+            std::error_code ec;
+            fs::create_directories(out_dir, ec);
+            if (ec) {
+                std::cerr << "Cannot create output directory: " << out_dir << "\n";
+                return 1;
             }
         }
-        else if (auto start = std::dynamic_pointer_cast<StartBlock>(stmt)) {
-            std::cerr << "Start block, body size = " << start->body.size() << "\n";
+
+        // Outputs are derived from the input names, so two inputs mapping to
+        // the same file would make the result depend on scheduling.
+        std::map<std::string, std::string> claimed;
+        for (const auto& in : inputs) {
+            fs::path out = fs::path(in).replace_extension(output_extension(options.output));
+            if (have_out_dir) out = fs::path(out_dir) / out.filename();
+
+            auto [it, fresh] = claimed.emplace(out.lexically_normal().string(), in);
+            if (!fresh) {
+                std::cerr << "Inputs " << it->second << " and " << in
+                    << " would both be written to " << out.string() << "\n";
+                return 1;
+            }
+            jobs.push_back({ in, out.string() });
         }
     }
-    std::cerr << "===========\n";
-#endif
-    auto cpp_code = generate_cpp(ast);
 
-    std::ofstream output(argv[2]);
-    if (!output) {
-        std::cerr << "Cannot write to output file: " << argv[2] << "\n";
+    if (jobs.empty()) {
+        print_usage();
         return 1;
     }
-    output << cpp_code;
-    output.close();
 
-    std::cout << "Compilation successful: " << argv[2] << "\n";
-    return 0;
+    auto results = compile_all(jobs, threads, options);
+
+    int failures = 0;
+    CompileStats total;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        total.merge(results[i].stats);
+        std::cerr << results[i].diagnostics;
+        if (results[i].ok) {
+            std::cout << "Compilation successful: " << jobs[i].output << "\n";
+        }
+        else {
+            std::cerr << "Compilation failed: " << jobs[i].input << "\n";
+            ++failures;
+        }
+    }
+
+    if (jobs.size() > 1 && failures > 0) {
+        std::cerr << failures << " of " << jobs.size() << " files failed to compile\n";
+    }
+
+    if (options.time_passes && !write_stats(total, start_wall, stats_console, stats_json, stats_file)) {
+        return 1;
+    }
+    return failures == 0 ? 0 : 1;
 }
@@ -0,0 +1,116 @@
+// mapped_file.cpp - Read-only memory-mapped source files
+#include "mapped_file.hpp"
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    move_from(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        move_from(other);
+    }
+    return *this;
+}
+
+void MappedFile::move_from(MappedFile& other) noexcept {
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    fallback_ = std::move(other.fallback_);
+    open_ = std::exchange(other.open_, false);
+#ifdef _WIN32
+    file_ = std::exchange(other.file_, nullptr);
+    mapping_ = std::exchange(other.mapping_, nullptr);
+#endif
+}
+
+std::string_view MappedFile::view() const {
+    if (data_) return std::string_view(data_, size_);
+    return fallback_;
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) {
+                void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (data) {
+                    file_ = file;
+                    mapping_ = mapping;
+                    data_ = static_cast<const char*>(data);
+                    size_ = static_cast<std::size_t>(size.QuadPart);
+                    open_ = true;
+                    return true;
+                }
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* data = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                madvise(data, static_cast<std::size_t>(st.st_size), MADV_SEQUENTIAL);
+                ::close(fd);
+                data_ = static_cast<const char*>(data);
+                size_ = static_cast<std::size_t>(st.st_size);
+                open_ = true;
+                return true;
+            }
+        }
+        ::close(fd);
+    }
+#endif
+
+    // Not mappable: fall back to an ordinary buffered read.
+    std::ifstream input(path, std::ios::binary);
+    if (!input) return false;
+    fallback_.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    open_ = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) {
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+        CloseHandle(static_cast<HANDLE>(mapping_));
+        CloseHandle(static_cast<HANDLE>(file_));
+        mapping_ = nullptr;
+        file_ = nullptr;
+#else
+        munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+    data_ = nullptr;
+    size_ = 0;
+    fallback_.clear();
+    open_ = false;
+}
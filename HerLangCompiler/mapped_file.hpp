@@ -0,0 +1,38 @@
+// mapped_file.hpp - Read-only memory-mapped source files
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+// Maps a whole file into memory so the lexer can hand out tokens that point
+// straight into it. Inputs that cannot be mapped (pipes, empty files) are read
+// into an owned buffer instead, so view() always works after a successful open().
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool open(const std::string& path);
+    void close();
+
+    bool is_open() const { return open_; }
+    bool is_mapped() const { return data_ != nullptr; }
+    std::string_view view() const;
+
+private:
+    void move_from(MappedFile& other) noexcept;
+
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::string fallback_;
+    bool open_ = false;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
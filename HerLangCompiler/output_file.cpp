@@ -0,0 +1,121 @@
+// output_file.cpp - Buffered output straight to a file descriptor
+#include "output_file.hpp"
+#include "stats.hpp"
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+OutputFile::~OutputFile() {
+    close();
+}
+
+bool OutputFile::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    fd_ = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    failed_ = false;
+    io_wall_ = io_cpu_ = 0;
+    bytes_written_ = 0;
+    if (fd_ < 0) return false;
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+    return true;
+}
+
+bool OutputFile::close() {
+    if (fd_ < 0) return !failed_;
+
+    flush_buffer();
+    double wall = timing_ ? wall_seconds() : 0;
+    double cpu = timing_ ? thread_cpu_seconds() : 0;
+#ifdef _WIN32
+    if (_close(fd_) != 0) failed_ = true;
+#else
+    if (::close(fd_) != 0) failed_ = true;
+#endif
+    if (timing_) {
+        io_wall_ += wall_seconds() - wall;
+        io_cpu_ += thread_cpu_seconds() - cpu;
+    }
+    fd_ = -1;
+    setp(nullptr, nullptr);
+    return !failed_;
+}
+
+bool OutputFile::write_all(const char* data, std::size_t size) {
+    double wall = timing_ ? wall_seconds() : 0;
+    double cpu = timing_ ? thread_cpu_seconds() : 0;
+    bytes_written_ += size;
+
+    bool ok = true;
+    while (size > 0) {
+#ifdef _WIN32
+        int chunk = size > (1u << 30) ? (1 << 30) : static_cast<int>(size);
+        int n = _write(fd_, data, static_cast<unsigned>(chunk));
+#else
+        ssize_t n = ::write(fd_, data, size);
+#endif
+        if (n <= 0) {
+            failed_ = true;
+            ok = false;
+            break;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+
+    if (timing_) {
+        io_wall_ += wall_seconds() - wall;
+        io_cpu_ += thread_cpu_seconds() - cpu;
+    }
+    return ok;
+}
+
+bool OutputFile::flush_buffer() {
+    std::size_t pending = static_cast<std::size_t>(pptr() - pbase());
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+    return pending == 0 || write_all(buffer_.data(), pending);
+}
+
+OutputFile::int_type OutputFile::overflow(int_type ch) {
+    if (fd_ < 0 || !flush_buffer()) return traits_type::eof();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize OutputFile::xsputn(const char* s, std::streamsize n) {
+    if (fd_ < 0) return 0;
+
+    std::size_t size = static_cast<std::size_t>(n);
+    std::size_t room = static_cast<std::size_t>(epptr() - pptr());
+    if (size <= room) {
+        std::memcpy(pptr(), s, size);
+        pbump(static_cast<int>(size));
+        return n;
+    }
+
+    if (!flush_buffer()) return 0;
+    if (size >= buffer_.size()) {
+        return write_all(s, size) ? n : 0;
+    }
+    std::memcpy(pptr(), s, size);
+    pbump(static_cast<int>(size));
+    return n;
+}
+
+int OutputFile::sync() {
+    if (fd_ < 0) return 0;
+    return flush_buffer() ? 0 : -1;
+}
@@ -0,0 +1,48 @@
+// output_file.hpp - Buffered output straight to a file descriptor
+#pragma once
+#include <cstddef>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// A std::streambuf over a raw file descriptor with one fixed buffer. Unlike
+// std::ofstream there is no locale or text-mode translation in the way, and
+// writes larger than the buffer go to the descriptor directly.
+class OutputFile : public std::streambuf {
+public:
+    explicit OutputFile(std::size_t buffer_size = 1 << 16) : buffer_(buffer_size) {}
+    ~OutputFile() override;
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    bool open(const std::string& path);
+    // Flushes and closes. Returns false if any write since open() failed.
+    bool close();
+
+    bool is_open() const { return fd_ >= 0; }
+
+    // With timing on, wall and CPU time spent inside write/close calls is
+    // accumulated so callers can separate I/O from formatting.
+    void set_timing(bool on) { timing_ = on; }
+    double io_wall() const { return io_wall_; }
+    double io_cpu() const { return io_cpu_; }
+    unsigned long long bytes_written() const { return bytes_written_; }
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int sync() override;
+
+private:
+    bool write_all(const char* data, std::size_t size);
+    bool flush_buffer();
+
+    std::vector<char> buffer_;
+    int fd_ = -1;
+    bool failed_ = false;
+    bool timing_ = false;
+    double io_wall_ = 0;
+    double io_cpu_ = 0;
+    unsigned long long bytes_written_ = 0;
+};
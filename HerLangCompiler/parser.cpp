@@ -1,82 +1,154 @@
 // parser.cpp - MyLang parser implementation
 #include "parser.hpp"
 #include "utils.hpp"
+#include <charconv>
+#include <cstdint>
 #include <stdexcept>
 #include <iostream>
 
-static int pos = 0;
-static std::vector<Token> toks;
+static const Token eof_token{ TokenType::EOFToken, "", 0 };
+static constexpr NodeId no_node = static_cast<NodeId>(-1);
 
-static Token dummy_eof_token() {
-    return Token{ TokenType::EOFToken, "" };
-}
+Parser::Parser(const std::vector<Token>& tokens, AST& ast)
+    : toks_(tokens.data()), count_(tokens.size()), ast_(ast) {}
 
-static Token peek() {
-    if (pos >= toks.size()) {
+const Token& Parser::peek() const {
+    if (pos_ >= count_) {
 #if _DEBUG
-        std::cerr << "[ERROR] peek: pos=" << pos << ", toks.size=" << toks.size() << "\n";
+        std::cerr << "[ERROR] peek: pos=" << pos_ << ", toks.size=" << count_ << "\n";
 #endif
-        return dummy_eof_token();
+        return eof_token;
     }
-    auto t = toks[pos];
+    const Token& t = toks_[pos_];
 #if _DEBUG
-    std::cerr << "[peek] pos=" << pos << ", token=(" << t.value << ")\n";
+    std::cerr << "[peek] pos=" << pos_ << ", token=(" << t.value << ")\n";
 #endif
     return t;
 }
 
-static Token advance() {
-    if (pos >= toks.size()) {
+const Token& Parser::advance() {
+    if (pos_ >= count_) {
 #if _DEBUG
-        std::cerr << "[ERROR] advance: pos=" << pos << ", toks.size=" << toks.size() << "\n";
+        std::cerr << "[ERROR] advance: pos=" << pos_ << ", toks.size=" << count_ << "\n";
 #endif
-        return dummy_eof_token();
+        return eof_token;
     }
-    auto t = toks[pos++];
+    const Token& t = toks_[pos_++];
 #if _DEBUG
-    std::cerr << "[advance] pos=" << pos << ", token=(" << t.value << ")\n";
+    std::cerr << "[advance] pos=" << pos_ << ", token=(" << t.value << ")\n";
 #endif
     return t;
 }
 
-static void skip_newlines() {
+void Parser::skip_newlines() {
     while (peek().type == TokenType::Newline) {
         advance();
     }
 }
 
-std::shared_ptr<Statement> parse_statement();
+NodeId Parser::make_node(NodeKind kind, int line, std::string_view name, std::string_view text) {
+    Node node;
+    node.kind = kind;
+    node.line = line;
+    node.name = name;
+    node.text = text;
+    return ast_.add(node);
+}
 
-AST parse(const std::vector<Token>& tokens) {
-    toks = tokens;
-    pos = 0;
-    AST ast;
+NodeId Parser::make_operand(const Token& tok) {
+    if (tok.type == TokenType::StringLiteral)
+        return make_node(NodeKind::StringLiteral, tok.line, {}, tok.value);
+    if (tok.type == TokenType::Number)
+        return make_node(NodeKind::NumberLiteral, tok.line, {}, tok.value);
+    return make_node(NodeKind::Variable, tok.line, tok.value);
+}
 
-    while (pos < toks.size()) {
-        Token current = peek();
-        if (current.type == TokenType::EOFToken) break;
+// A name, or a path to a record's field or method: "p.age". The rest of a
+// path is consumed; it always follows `first` on the same line.
+std::string_view Parser::path(const Token& first) {
+    if (first.type != TokenType::Identifier || pos_ + 1 >= count_ || toks_[pos_].type != TokenType::Symbol ||
+        toks_[pos_].value != "." || toks_[pos_ + 1].type != TokenType::Identifier) {
+        return first.value;
+    }
+    advance();
+    std::string_view member = advance().value;
+    return ast_.intern(std::string(first.value) + "." + std::string(member));
+}
 
-        auto stmt = parse_statement();
-        if (stmt) {
-            ast.statements.push_back(stmt);
-        }
-        else {
-            advance();
+// make_operand for an operand that may be a path.
+NodeId Parser::make_value(const Token& tok) {
+    if (tok.type != TokenType::Identifier) return make_operand(tok);
+    return make_node(NodeKind::Variable, tok.line, path(tok));
+}
+
+static bool is_operand(const Token& tok) {
+    return tok.type == TokenType::StringLiteral || tok.type == TokenType::Identifier ||
+        tok.type == TokenType::Number;
+}
+
+static bool is_symbol(const Token& tok, std::string_view symbol) {
+    return tok.type == TokenType::Symbol && tok.value == symbol;
+}
+
+// Words such as `times` and `in` are only looked for where the grammar
+// expects them, and are ordinary names everywhere else.
+static bool is_word(const Token& tok, std::string_view word) {
+    return tok.type == TokenType::Identifier && tok.value == word;
+}
+
+// A whole, non-negative number that fits in 32 bits.
+static bool is_u32(std::string_view text) {
+    uint32_t value = 0;
+    auto r = std::from_chars(text.data(), text.data() + text.size(), value);
+    return r.ec == std::errc() && r.ptr == text.data() + text.size();
+}
+
+// Makes `node` the parent of a single operand.
+NodeId Parser::with_operand(NodeId node, NodeId operand) {
+    size_t mark = ast_.open_list();
+    ast_.push_child(operand);
+    ast_.close_list(node, mark);
+    return node;
+}
+
+bool Parser::parse_next() {
+    while (pos_ < count_) {
+        if (peek().type == TokenType::EOFToken) return false;
+
+        NodeId stmt = parse_statement();
+        if (stmt != no_node) {
+            ast_.statements.push_back(stmt);
+            return true;
         }
+        advance();
     }
+    return false;
+}
 
+void Parser::parse_all() {
+    while (parse_next()) {}
+}
+
+bool opens_block(const Token& tok) {
+    return tok.type == TokenType::Keyword && (keyword_flags(tok.value) & OpensBlock);
+}
+
+AST parse(const std::vector<Token>& tokens) {
+    AST ast;
+    Parser(tokens, ast).parse_all();
     return ast;
 }
 
-std::vector<std::shared_ptr<Statement>> parse_block() {
-    std::vector<std::shared_ptr<Statement>> body;
+// Parses statements up to the matching 'end' and attaches them to `parent`.
+void Parser::parse_block(NodeId parent) {
+    size_t mark = ast_.open_list();
     int safety_counter = 0;
 
     while (true) {
         skip_newlines();
 
-        Token current = peek();
-        if (current.type == TokenType::Keyword && current.value == "end") {
+        const Token& current = peek();
+        if (current.kw == Keyword::End) {
             advance(); // consume "end"
             break;
         }
@@ -85,8 +157,8 @@ std::vector<std::shared_ptr<Statement>> parse_block() {
         }
 
         auto stmt = parse_statement();
-        if (stmt) {
-            body.push_back(stmt);
+        if (stmt != no_node) {
+            ast_.push_child(stmt);
         }
         else {
             advance();
@@ -97,76 +169,377 @@ std::vector<std::shared_ptr<Statement>> parse_block() {
         }
     }
 
-    return body;
+    ast_.close_list(parent, mark);
+}
+
+// list name = source.filter_gently(x -> x > 3).transform_kindly(x -> x * 2)
+// The chain may go on over following lines that start with '.'.
+NodeId Parser::parse_pipeline(int line, std::string_view name, std::string_view source) {
+    size_t mark = ast_.open_list();
+    while (true) {
+        size_t line_end = pos_;
+        skip_newlines();
+        if (!is_symbol(peek(), ".")) {
+            pos_ = line_end;
+            break;
+        }
+        advance();
+        ast_.push_child(parse_stage());
+    }
+    if (ast_.open_list() == mark) {
+        throw std::runtime_error("Expected '.filter_gently(...)' or '.transform_kindly(...)' after '" +
+            std::string(source) + "' at line " + std::to_string(line));
+    }
+
+    NodeId pipeline = make_node(NodeKind::Pipeline, line, name, source);
+    ast_.close_list(pipeline, mark);
+    return pipeline;
+}
+
+// filter_gently(x -> x < 3), filter_gently(x -> x.contains("a")) or
+// transform_kindly(x -> x * 2): one step on one element, whose variable
+// comes first.
+NodeId Parser::parse_stage() {
+    const Token& stage = advance();
+    const Token& open = advance();
+    const Token& var = advance();
+    const Token& arrow = advance();
+    const Token& self = advance();
+    bool filter = stage.value == "filter_gently";
+    if ((!filter && stage.value != "transform_kindly") || !is_symbol(open, "(") ||
+        var.type != TokenType::Identifier || !is_symbol(arrow, "->") || self.value != var.value) {
+        throw std::runtime_error("Expected '.filter_gently(<name> -> <name> ...)' or "
+            "'.transform_kindly(<name> -> <name> ...)' at line " + std::to_string(stage.line));
+    }
+
+    const Token& op = advance();
+    std::string_view spelling = op.value;
+    const Token* operand = nullptr;
+    if (is_symbol(op, ".")) {
+        // x.contains("text"), x.starts_with("text"), x.ends_with("text")
+        const Token& method = advance();
+        const Token& paren = advance();
+        operand = &advance();
+        const Token& close = advance();
+        spelling = method.value;
+        if ((spelling != "contains" && spelling != "starts_with" && spelling != "ends_with") ||
+            !is_symbol(paren, "(") || operand->type != TokenType::StringLiteral || !is_symbol(close, ")")) {
+            throw std::runtime_error("Expected '" + std::string(var.value) + ".contains(\"...\")', '.starts_with(\"...\")' "
+                "or '.ends_with(\"...\")' at line " + std::to_string(op.line));
+        }
+    }
+    else if (op.type == TokenType::Symbol) {
+        operand = &advance();
+        if (!is_operand(*operand)) {
+            throw std::runtime_error("Expected a number, text or variable after '" + std::string(spelling) +
+                "' at line " + std::to_string(op.line));
+        }
+    }
+
+    bool compares = spelling == "<" || spelling == "<=" || spelling == ">" || spelling == ">=" ||
+        spelling == "==" || spelling == "!=" || spelling == "contains" || spelling == "starts_with" ||
+        spelling == "ends_with";
+    bool calculates = spelling == "+" || spelling == "-" || spelling == "*" || spelling == "/";
+    if (!operand || (filter ? !compares : !calculates)) {
+        throw std::runtime_error(filter
+            ? "filter_gently needs a comparison such as 'x > 3' or 'x.contains(\"a\")' at line " + std::to_string(op.line)
+            : "transform_kindly needs a calculation such as 'x * 2' at line " + std::to_string(op.line));
+    }
+    if (!is_symbol(advance(), ")")) {
+        throw std::runtime_error("Expected ')' to close '" + std::string(stage.value) + "' at line " +
+            std::to_string(stage.line));
+    }
+
+    NodeId node = make_node(filter ? NodeKind::Filter : NodeKind::Transform, stage.line, var.value, spelling);
+    return with_operand(node, make_operand(*operand));
+}
+
+// gentle_type Person:            or   gentle_type Person as columns:
+//     name: String
+//     age: Number
+//     gentle_method greet():
+//         say "I am " self.name
+//     end
+// end
+//
+// A type may list cases instead, each with fields of its own:
+//
+// gentle_type Response:
+//     case Success(data: String)
+//     case Error(code: Number, message: String)
+//     case Timeout
+// end
+NodeId Parser::parse_type(const Token& tok) {
+    const Token& name = advance();
+    if (name.type != TokenType::Identifier) {
+        throw std::runtime_error("Expected 'gentle_type <name>:' at line " + std::to_string(tok.line));
+    }
+    std::string_view layout;
+    if (peek().value == "as") {
+        advance();
+        layout = advance().value;
+        if (layout != "columns") {
+            throw std::runtime_error("Expected 'gentle_type " + std::string(name.value) + " as columns:' at line " +
+                std::to_string(tok.line));
+        }
+    }
+    if (!is_symbol(advance(), ":")) {
+        throw std::runtime_error("Expected ':' after 'gentle_type " + std::string(name.value) + "' at line " +
+            std::to_string(tok.line));
+    }
+
+    NodeId type = make_node(NodeKind::TypeDef, tok.line, name.value, layout);
+    size_t mark = ast_.open_list();
+    while (true) {
+        skip_newlines();
+        const Token& current = advance();
+        if (current.kw == Keyword::End) break;
+        if (current.type == TokenType::EOFToken) {
+            throw std::runtime_error("Unexpected end of file inside gentle_type " + std::string(name.value) + ".");
+        }
+
+        if (current.kw == Keyword::Method) {
+            const Token& method = advance();
+            if (method.type != TokenType::Identifier) {
+                throw std::runtime_error("Expected 'gentle_method <name>():' at line " + std::to_string(current.line));
+            }
+            if (is_symbol(peek(), "(")) {
+                advance();
+                if (!is_symbol(advance(), ")")) {
+                    throw std::runtime_error("Methods take no parameters besides self at line " +
+                        std::to_string(current.line));
+                }
+            }
+            if (!is_symbol(advance(), ":")) {
+                throw std::runtime_error("Expected ':' after 'gentle_method " + std::string(method.value) +
+                    "' at line " + std::to_string(current.line));
+            }
+            NodeId def = make_node(NodeKind::Method, current.line, method.value, name.value);
+            parse_block(def);
+            ast_.push_child(def);
+            continue;
+        }
+
+        // `case: Number` is a field that happens to be called case.
+        if (is_word(current, "case") && !is_symbol(peek(), ":")) {
+            ast_.push_child(parse_case(current, name.value));
+            continue;
+        }
+
+        // name: Type, where the type is everything up to the end of the line
+        if (current.type != TokenType::Identifier || !is_symbol(advance(), ":") ||
+            peek().type == TokenType::Newline) {
+            throw std::runtime_error("Expected '<field>: <type>' or 'gentle_method' in gentle_type " +
+                std::string(name.value) + " at line " + std::to_string(current.line));
+        }
+        std::string spelled;
+        while (peek().type != TokenType::Newline && peek().type != TokenType::EOFToken) spelled += advance().value;
+        ast_.push_child(make_node(NodeKind::Field, current.line, current.value, ast_.intern(spelled)));
+    }
+    ast_.close_list(type, mark);
+    return type;
+}
+
+// case Error(code: Number, message: String) in a gentle_type; 'case' has
+// been consumed.
+NodeId Parser::parse_case(const Token& tok, std::string_view type) {
+    const Token& name = advance();
+    if (name.type != TokenType::Identifier || name.value == "_") {
+        throw std::runtime_error("Expected 'case <name>' or 'case <name>(<field>: <type>, ...)' in gentle_type " +
+            std::string(type) + " at line " + std::to_string(tok.line));
+    }
+    NodeId node = make_node(NodeKind::Case, tok.line, name.value);
+    size_t mark = ast_.open_list();
+    if (is_symbol(peek(), "(")) {
+        advance();
+        while (!is_symbol(peek(), ")")) {
+            const Token& field = advance();
+            const Token& colon = advance();
+            const Token& field_type = advance();
+            if (field.type != TokenType::Identifier || !is_symbol(colon, ":") || field_type.type != TokenType::Identifier) {
+                throw std::runtime_error("Expected '<field>: <type>' in case " + std::string(name.value) + " at line " +
+                    std::to_string(tok.line));
+            }
+            ast_.push_child(make_node(NodeKind::Field, tok.line, field.value, field_type.value));
+            if (!is_symbol(peek(), ",")) break;
+            advance();
+        }
+        if (!is_symbol(advance(), ")")) {
+            throw std::runtime_error("Expected ',' or ')' in case " + std::string(name.value) + " at line " +
+                std::to_string(tok.line));
+        }
+    }
+    if (peek().type != TokenType::Newline) {
+        throw std::runtime_error("Unexpected '" + std::string(peek().value) + "' after case " + std::string(name.value) +
+            " at line " + std::to_string(tok.line));
+    }
+    ast_.close_list(node, mark);
+    return node;
+}
+
+// match_gently response:
+//     case Error(code, message):
+//         say "error " code ": " message
+//     case _:
+//         say "something else"
+// end
+// Each arm runs up to the next line starting with 'case' or the 'end' of
+// the match; elsewhere 'case' is an ordinary name.
+NodeId Parser::parse_match(const Token& tok) {
+    const Token& var = advance();
+    if (var.type != TokenType::Identifier || !is_symbol(advance(), ":")) {
+        throw std::runtime_error("Expected 'match_gently <name>:' at line " + std::to_string(tok.line));
+    }
+
+    NodeId match = make_node(NodeKind::Match, tok.line, var.value);
+    size_t mark = ast_.open_list();
+    while (true) {
+        skip_newlines();
+        const Token& current = advance();
+        if (current.kw == Keyword::End) break;
+        if (!is_word(current, "case")) {
+            throw std::runtime_error(current.type == TokenType::EOFToken
+                ? "Unexpected end of file inside match_gently " + std::string(var.value) + "."
+                : "Expected 'case <name>:' in match_gently at line " + std::to_string(current.line));
+        }
+
+        const Token& name = advance();
+        if (name.type != TokenType::Identifier) {
+            throw std::runtime_error("Expected 'case <name>:' or 'case _:' at line " + std::to_string(current.line));
+        }
+        std::string bound;
+        if (is_symbol(peek(), "(")) {
+            if (name.value == "_") {
+                throw std::runtime_error("'case _' binds no names at line " + std::to_string(current.line));
+            }
+            advance();
+            while (!is_symbol(peek(), ")")) {
+                const Token& binding = advance();
+                if (binding.type != TokenType::Identifier) {
+                    throw std::runtime_error("Expected 'case " + std::string(name.value) + "(<name>, ...):' at line " +
+                        std::to_string(current.line));
+                }
+                if (!bound.empty()) bound += ',';
+                bound += binding.value;
+                if (!is_symbol(peek(), ",")) break;
+                advance();
+            }
+            if (!is_symbol(advance(), ")")) {
+                throw std::runtime_error("Expected ',' or ')' after 'case " + std::string(name.value) + "(' at line " +
+                    std::to_string(current.line));
+            }
+        }
+        if (!is_symbol(advance(), ":")) {
+            throw std::runtime_error("Expected ':' after 'case " + std::string(name.value) + "' at line " +
+                std::to_string(current.line));
+        }
+
+        NodeId arm = make_node(NodeKind::Arm, current.line, name.value, ast_.intern(bound));
+        size_t body = ast_.open_list();
+        while (true) {
+            skip_newlines();
+            const Token& next = peek();
+            if (next.kw == Keyword::End || is_word(next, "case") || next.type == TokenType::EOFToken) break;
+            NodeId stmt = parse_statement();
+            if (stmt != no_node) ast_.push_child(stmt);
+            else advance();
+        }
+        ast_.close_list(arm, body);
+        ast_.push_child(arm);
+    }
+    ast_.close_list(match, mark);
+    return match;
+}
+
+// Person("Alice", 30) inside a list literal; `type` has been consumed.
+NodeId Parser::parse_record(const Token& type) {
+    advance(); // consume '('
+    size_t mark = ast_.open_list();
+    if (!is_symbol(peek(), ")")) {
+        while (true) {
+            const Token& value = advance();
+            if (value.type != TokenType::StringLiteral && value.type != TokenType::Number) {
+                throw std::runtime_error("The fields of " + std::string(type.value) +
+                    "(...) must be strings or numbers at line " + std::to_string(value.line));
+            }
+            ast_.push_child(make_operand(value));
+            if (!is_symbol(peek(), ",")) break;
+            advance();
+        }
+    }
+    if (!is_symbol(advance(), ")")) {
+        throw std::runtime_error("Expected ',' or ')' in " + std::string(type.value) + "(...) at line " +
+            std::to_string(type.line));
+    }
+    NodeId record = make_node(NodeKind::RecordLiteral, type.line, type.value);
+    ast_.close_list(record, mark);
+    return record;
 }
 
-std::shared_ptr<Statement> parse_statement() {
+NodeId Parser::parse_statement() {
     skip_newlines();
 
-    Token tok = peek();
+    const Token& tok = peek();
 
     if (tok.type == TokenType::EOFToken) {
-        return nullptr;
+        return no_node;
     }
 
     // function definition
-    if (tok.type == TokenType::Keyword && tok.value == "function") {
+    if (tok.kw == Keyword::Function) {
         advance(); // consume 'function'
 
-        Token name = advance();
-        Token maybe_param_or_colon = advance();
+        const Token& name = advance();
+        const Token& maybe_param_or_colon = advance();
 
-        std::string param = "";
+        std::string_view param;
 
-        Token colon;
-        if (maybe_param_or_colon.type == TokenType::Symbol && maybe_param_or_colon.value == ":") {
-            colon = maybe_param_or_colon;
-        }
-        else {
+        if (maybe_param_or_colon.type != TokenType::Symbol || maybe_param_or_colon.value != ":") {
             param = maybe_param_or_colon.value;
-            colon = advance();
+            const Token& colon = advance();
             if (colon.value != ":") {
                 throw std::runtime_error("Expected ':' after parameter in function definition");
             }
         }
 
-        auto body = parse_block();
-        return std::make_shared<FunctionDef>(name.value, param, body);
+        NodeId func = make_node(NodeKind::FunctionDef, tok.line, name.value, param);
+        parse_block(func);
+        return func;
     }
 
     // start block
-    if (tok.type == TokenType::Keyword && tok.value == "start") {
+    if (tok.kw == Keyword::Start) {
         advance();
-        Token colon = advance();
+        const Token& colon = advance();
         if (colon.value != ":") throw std::runtime_error("Expected ':' after start");
-        auto body = parse_block();
-        return std::make_shared<StartBlock>(body);
+        NodeId start = make_node(NodeKind::StartBlock, tok.line);
+        parse_block(start);
+        return start;
     }
 
     // say
-    if (tok.type == TokenType::Keyword && tok.value == "say") {
+    if (tok.kw == Keyword::Say) {
         advance(); // consume 'say'
 
-        std::vector<std::string> args;
-        std::vector<bool> is_vars;
-        std::string ending = "\\n"; // default end
+        size_t mark = ast_.open_list();
+        std::string_view ending = "\\n"; // default end
 
         while (true) {
-            Token next = peek();
+            const Token& next = peek();
 #if _DEBUG
             std::cerr << "[DEBUG] say loop: next=" << next.value << ", type=" << static_cast<int>(next.type) << "\n";
 #endif
 
-            if (next.type == TokenType::Keyword && next.value == "end") {
+            if (next.kw == Keyword::End) {
                 advance(); // consume 'end'
 
-                Token eq = peek();
+                const Token& eq = peek();
                 if (eq.type != TokenType::Symbol || eq.value != "=") {
                     throw std::runtime_error("Expected '=' after 'end'");
                 }
                 advance(); // consume '='
 
-                Token val = peek();
+                const Token& val = peek();
                 if (val.type != TokenType::StringLiteral) {
                     throw std::runtime_error("Expected string literal after end=");
                 }
@@ -181,62 +554,243 @@ std::shared_ptr<Statement> parse_statement() {
             }
 
             
-            if (next.type == TokenType::StringLiteral || next.type == TokenType::Identifier) {
-                Token arg = advance();
-                args.push_back(arg.value);
-                is_vars.push_back(arg.type == TokenType::Identifier);
+            if (is_operand(next)) {
+                ast_.push_child(make_value(advance()));
 
                 
-                Token comma = peek();
-                if (comma.type == TokenType::Symbol && comma.value == ",") {
+                // Arguments may be separated by ',' or '+', or just by spaces.
+                const Token& comma = peek();
+                if (is_symbol(comma, ",") || is_symbol(comma, "+")) {
                     advance(); // consume comma
                 }
             }
             else {
-                throw std::runtime_error("Unexpected token in 'say': " + next.value);
+                throw std::runtime_error("Unexpected token in 'say': " + std::string(next.value));
             }
         }
 
-        if (args.size() != is_vars.size()) {
-            throw std::runtime_error("Internal error: say args/vars mismatch.");
+        NodeId say = make_node(NodeKind::Say, tok.line, {}, ending);
+        ast_.close_list(say, mark);
+        return say;
+    }
+
+    // set x / set x = value
+    if (tok.kw == Keyword::Set) {
+        advance();
+        const Token& var = advance();
+        if (var.type != TokenType::Identifier) {
+            throw std::runtime_error("Expected a variable name after 'set' at line " + std::to_string(tok.line));
+        }
+        std::string_view target = path(var);
+        NodeId set = make_node(NodeKind::Set, tok.line, target);
+
+        const Token& eq = peek();
+        if (eq.type != TokenType::Symbol || eq.value != "=") return set;
+        advance();
+        const Token& value = advance();
+        if (value.type != TokenType::Number && value.type != TokenType::Identifier) {
+            throw std::runtime_error("Expected a number or variable after 'set " + std::string(target) +
+                " =' at line " + std::to_string(tok.line));
         }
+        return with_operand(set, make_value(value));
+    }
 
-        return std::make_shared<SayStatement>(args, is_vars, ending);
+    // add x value / minus x value / multiply x value / divide x value
+    if (tok.kw == Keyword::Add || tok.kw == Keyword::Minus ||
+        tok.kw == Keyword::Multiply || tok.kw == Keyword::Divide) {
+        advance();
+        const Token& var = advance();
+        std::string_view target = path(var);
+        const Token& value = advance();
+        if (var.type != TokenType::Identifier ||
+            (value.type != TokenType::Number && value.type != TokenType::Identifier)) {
+            throw std::runtime_error("Expected '" + std::string(tok.value) +
+                " <variable> <number or variable>' at line " + std::to_string(tok.line));
+        }
+        NodeKind kind = tok.kw == Keyword::Add ? NodeKind::Add
+            : tok.kw == Keyword::Minus ? NodeKind::Minus
+            : tok.kw == Keyword::Multiply ? NodeKind::Multiply
+            : NodeKind::Divide;
+        return with_operand(make_node(kind, tok.line, target), make_value(value));
     }
 
-    // set
-    if (tok.type == TokenType::Keyword && tok.value == "set") {
+    // repeat N times: ... end
+    if (tok.kw == Keyword::Repeat) {
         advance();
-        Token var = advance();
-        return std::make_shared<SetStatement>(var.value);
+        const Token& count = advance();
+        std::string_view count_name = path(count);
+        const Token& times = advance();
+        const Token& colon = advance();
+        if ((count.type != TokenType::Number && count.type != TokenType::Identifier) ||
+            !is_word(times, "times") || colon.value != ":") {
+            throw std::runtime_error("Expected 'repeat <number or variable> times:' at line " + std::to_string(tok.line));
+        }
+        NodeId loop = count.type == TokenType::Number
+            ? make_node(NodeKind::Repeat, tok.line, {}, count.value)
+            : make_node(NodeKind::Repeat, tok.line, count_name);
+        parse_block(loop);
+        return loop;
+    }
+
+    // gentle_list name = [a, b, ...]; the elements may span several lines
+    if (tok.kw == Keyword::List) {
+        advance();
+        const Token& name = advance();
+        const Token& eq = advance();
+        const Token& open = advance();
+        if (name.type != TokenType::Identifier || eq.value != "=" ||
+            (open.value != "[" && open.type != TokenType::Identifier)) {
+            throw std::runtime_error("Expected 'gentle_list <name> = [...]' or 'gentle_list <name> = <list>.filter_gently(...)' at line " +
+                std::to_string(tok.line));
+        }
+        if (open.type == TokenType::Identifier) return parse_pipeline(tok.line, name.value, open.value);
+
+        size_t mark = ast_.open_list();
+        while (true) {
+            skip_newlines();
+            const Token& next = advance();
+            if (next.type == TokenType::Symbol && next.value == "]") break;
+            if (next.type == TokenType::Identifier && is_symbol(peek(), "(")) {
+                ast_.push_child(parse_record(next));
+            }
+            else if (next.type != TokenType::StringLiteral && next.type != TokenType::Number) {
+                throw std::runtime_error("List elements must be strings, numbers or records at line " + std::to_string(next.line));
+            }
+            else {
+                ast_.push_child(make_operand(next));
+            }
+
+            skip_newlines();
+            const Token& sep = peek();
+            if (sep.type == TokenType::Symbol && sep.value == ",") advance();
+            else if (sep.type != TokenType::Symbol || sep.value != "]") {
+                throw std::runtime_error("Expected ',' or ']' in list at line " + std::to_string(sep.line));
+            }
+        }
+
+        NodeId list = make_node(NodeKind::ListDef, tok.line, name.value);
+        ast_.close_list(list, mark);
+        return list;
+    }
+
+    // gently_for each x in xs: ... end
+    if (tok.kw == Keyword::For) {
+        advance();
+        const Token& each = advance();
+        const Token& var = advance();
+        const Token& in = advance();
+        const Token& list = advance();
+        const Token& colon = advance();
+        if (!is_word(each, "each") || var.type != TokenType::Identifier || !is_word(in, "in") ||
+            list.type != TokenType::Identifier || colon.value != ":") {
+            throw std::runtime_error("Expected 'gently_for each <name> in <list>:' at line " + std::to_string(tok.line));
+        }
+        NodeId loop = make_node(NodeKind::ForEach, tok.line, var.value, list.value);
+        parse_block(loop);
+        return loop;
+    }
+
+    // spawn_gently: ... end, optionally named: spawn_gently task1(): ... end
+    if (tok.kw == Keyword::Spawn) {
+        advance();
+        std::string_view label;
+        if (peek().type == TokenType::Identifier) {
+            label = advance().value;
+            if (is_symbol(peek(), "(")) {
+                advance();
+                if (!is_symbol(advance(), ")")) {
+                    throw std::runtime_error("A spawned block takes no parameters at line " + std::to_string(tok.line));
+                }
+            }
+        }
+        if (!is_symbol(advance(), ":")) {
+            throw std::runtime_error("Expected 'spawn_gently:' or 'spawn_gently <name>():' at line " + std::to_string(tok.line));
+        }
+        NodeId spawn = make_node(NodeKind::Spawn, tok.line, label);
+        parse_block(spawn);
+        return spawn;
+    }
+
+    // await_all_with_patience
+    if (tok.kw == Keyword::AwaitAll) {
+        advance();
+        return make_node(NodeKind::AwaitAll, tok.line);
+    }
+
+    // yield_kindly 500ms (or 500 ms)
+    if (tok.kw == Keyword::Yield) {
+        advance();
+        const Token& ms = advance();
+        const Token& unit = advance();
+        if (ms.type != TokenType::Number || unit.value != "ms" || !is_u32(ms.value)) {
+            throw std::runtime_error("Expected 'yield_kindly <whole number>ms' at line " + std::to_string(tok.line));
+        }
+        return make_node(NodeKind::Yield, tok.line, {}, ms.value);
+    }
+
+    // gentle_type Name: <fields and methods> end
+    if (tok.kw == Keyword::Type) {
+        advance();
+        return parse_type(tok);
+    }
+
+    // match_gently x: <case arms> end
+    if (tok.kw == Keyword::Match) {
+        advance();
+        return parse_match(tok);
+    }
+
+    if (tok.kw == Keyword::Method) {
+        throw std::runtime_error("'" + std::string(tok.value) + "' can only be used inside gentle_type at line " +
+            std::to_string(tok.line));
+    }
+
+    // flush
+    if (tok.kw == Keyword::Flush) {
+        advance();
+        return make_node(NodeKind::Flush, tok.line);
     }
 
     // function call
     if (tok.type == TokenType::Identifier) {
-        Token func = advance();
-        Token next = peek();
-        if (next.type == TokenType::StringLiteral || next.type == TokenType::Identifier) {
-            Token arg = advance();
+        const Token& func = advance();
+        // p.greet or p.greet(): a method of a record
+        std::string_view callee = path(func);
+        if (is_path(callee) && is_symbol(peek(), "(")) {
+            advance();
+            if (!is_symbol(advance(), ")")) {
+                throw std::runtime_error("Methods take no arguments at line " + std::to_string(func.line));
+            }
+        }
+        const Token& next = peek();
+        if (is_operand(next)) {
+            const Token& arg = advance();
 #if _DEBUG
             std::cerr << "[DEBUG] function call arg " << arg.value << " ";
             switch (arg.type) {
             case TokenType::Keyword:        std::cerr << "Keyword    "; break;
             case TokenType::Identifier:     std::cerr << "Identifier "; break;
             case TokenType::StringLiteral:  std::cerr << "String     "; break;
+            case TokenType::Number:         std::cerr << "Number     "; break;
             case TokenType::Newline:        std::cerr << "Newline    "; break;
             case TokenType::EOFToken:       std::cerr << "EOF        "; break;
             case TokenType::Symbol:         std::cerr << "Symbol     "; break;
             }
             std::cerr << std::endl;
 #endif
-            return std::make_shared<FunctionCall>(func.value, arg.value, arg.type);
+            NodeId operand = make_value(arg);
+            size_t mark = ast_.open_list();
+            ast_.push_child(operand);
+            NodeId call = make_node(NodeKind::FunctionCall, func.line, callee);
+            ast_.close_list(call, mark);
+            return call;
         }
         else {
-            return std::make_shared<FunctionCall>(func.value, "", TokenType::EOFToken);
+            return make_node(NodeKind::FunctionCall, func.line, callee);
         }
     }
 
 
     advance();
-    return nullptr;
+    return no_node;
 }
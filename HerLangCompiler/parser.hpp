@@ -2,6 +2,50 @@
 #pragma once
 #include "ast.hpp"
 #include "lexer.hpp"
+#include <cstddef>
 #include <vector>
 
+// Recursive-descent parser over a borrowed token stream. All state lives in
+// the object, so independent parsers can run concurrently on different
+// threads. The tokens (and the source they view) must outlive the parser
+// and the AST it fills.
+class Parser {
+public:
+    Parser(const std::vector<Token>& tokens, AST& ast);
+
+    // Parses the next top-level statement into ast.statements.
+    // Returns false once the end of the token stream is reached.
+    bool parse_next();
+    void parse_all();
+
+private:
+    const Token& peek() const;
+    const Token& advance();
+    void skip_newlines();
+
+    NodeId make_node(NodeKind kind, int line, std::string_view name = {}, std::string_view text = {});
+    NodeId make_operand(const Token& tok);
+    std::string_view path(const Token& first);
+    NodeId make_value(const Token& tok);
+    NodeId with_operand(NodeId node, NodeId operand);
+
+    NodeId parse_statement();
+    void parse_block(NodeId parent);
+    NodeId parse_pipeline(int line, std::string_view name, std::string_view source);
+    NodeId parse_stage();
+    NodeId parse_type(const Token& tok);
+    NodeId parse_case(const Token& tok, std::string_view type);
+    NodeId parse_match(const Token& tok);
+    NodeId parse_record(const Token& type);
+
+    const Token* toks_;
+    size_t count_;
+    size_t pos_ = 0;
+    AST& ast_;
+};
+
 AST parse(const std::vector<Token>& tokens);
+
+// True if a line starting with `tok` opens a block that a later line
+// consisting of just 'end' closes.
+bool opens_block(const Token& tok);
@@ -0,0 +1,153 @@
+// records.cpp - Record types declared with gentle_type
+#include "records.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+int RecordType::field(std::string_view name) const {
+    for (size_t i = 0; i < fields.size(); ++i) {
+        if (fields[i].name == name) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+bool RecordType::has_method(std::string_view name) const {
+    return std::find(methods.begin(), methods.end(), name) != methods.end();
+}
+
+int RecordType::find_case(std::string_view name) const {
+    for (size_t i = 0; i < cases.size(); ++i) {
+        if (cases[i].name == name) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+[[noreturn]] static void fail(const Node& at, const std::string& message) {
+    throw std::runtime_error("line " + std::to_string(at.line) + ": " + message);
+}
+
+// A Field node of `owner`, a type or a case, checked against the fields
+// it already has.
+static RecordField make_field(const Node& field, const std::vector<RecordField>& fields, const std::string& owner) {
+    for (const RecordField& other : fields) {
+        if (other.name == field.name) fail(field, "'" + std::string(field.name) + "' is already used in " + owner);
+    }
+    NumType type;
+    if (field.text == "String") type = NumType::None;
+    else if (field.text == "Number") type = NumType::Int;
+    else if (field.text == "Float") type = NumType::Float;
+    else {
+        fail(field, "field '" + std::string(field.name) + "' of " + owner + " is a " +
+            std::string(field.text) + "; fields are String, Number or Float");
+    }
+    return { std::string(field.name), type };
+}
+
+const RecordType& RecordTable::add(const AST& ast, NodeId def) {
+    const Node& node = ast[def];
+    if (types_.count(node.name)) fail(node, "type '" + std::string(node.name) + "' is defined twice");
+    if (cases_.count(node.name)) fail(node, "'" + std::string(node.name) + "' is already a case of " + cases_.find(node.name)->second);
+
+    RecordType type;
+    type.name = node.name;
+    type.columns = node.text == "columns";
+    for (NodeId id : ast.children(node)) {
+        const Node& member = ast[id];
+        if (type.field(member.name) >= 0 || type.has_method(member.name) || type.find_case(member.name) >= 0) {
+            fail(member, "'" + std::string(member.name) + "' is already used in type " + type.name);
+        }
+        if (member.kind == NodeKind::Method) {
+            type.methods.emplace_back(member.name);
+        }
+        else if (member.kind == NodeKind::Case) {
+            if (member.name == type.name || types_.count(member.name) || cases_.count(member.name)) {
+                fail(member, "'" + std::string(member.name) + "' is already the name of a type or case");
+            }
+            RecordCase value{ std::string(member.name), {} };
+            for (NodeId field : ast.children(member)) {
+                value.fields.push_back(make_field(ast[field], value.fields, "case " + value.name));
+            }
+            type.cases.push_back(std::move(value));
+        }
+        else {
+            type.fields.push_back(make_field(member, type.fields, "type " + type.name));
+        }
+    }
+    if (type.has_cases()) {
+        if (!type.fields.empty() || !type.methods.empty()) {
+            fail(node, "type '" + type.name + "' has cases, so it cannot also have fields or methods");
+        }
+        if (type.columns) fail(node, "type '" + type.name + "' has cases; only types with fields can be stored as columns");
+        // The tag is one byte.
+        if (type.cases.size() > 256) fail(node, "type '" + type.name + "' has more than 256 cases");
+    }
+    else if (type.fields.empty()) {
+        fail(node, "type '" + type.name + "' has no fields");
+    }
+
+    for (const RecordCase& value : type.cases) cases_.emplace(value.name, type.name);
+    std::string name = type.name;
+    return types_.emplace(std::move(name), std::move(type)).first->second;
+}
+
+const RecordType* RecordTable::find(std::string_view name) const {
+    auto it = types_.find(name);
+    return it != types_.end() ? &it->second : nullptr;
+}
+
+const RecordType* RecordTable::of_case(std::string_view name) const {
+    auto it = cases_.find(name);
+    return it != cases_.end() ? find(it->second) : nullptr;
+}
+
+static void mark_used(const AST& ast, ChildRange body, std::string_view var, const RecordType& type,
+    std::vector<bool>& used) {
+    auto use = [&](std::string_view name) {
+        if (!is_path(name) || path_base(name) != var) return;
+        int index = type.field(path_member(name));
+        if (index >= 0) used[index] = true;
+        else std::fill(used.begin(), used.end(), true);   // a method call
+    };
+    for (NodeId id : body) {
+        const Node& stmt = ast[id];
+        use(stmt.name);
+        if (has_body(stmt.kind)) {
+            mark_used(ast, ast.children(stmt), var, type, used);
+            continue;
+        }
+        for (NodeId operand : ast.children(stmt)) {
+            if (ast[operand].kind == NodeKind::Variable) use(ast[operand].name);
+        }
+    }
+}
+
+std::vector<bool> used_fields(const AST& ast, ChildRange body, std::string_view var, const RecordType& type) {
+    std::vector<bool> used(type.fields.size(), false);
+    mark_used(ast, body, var, type, used);
+    return used;
+}
+
+static void mark_bound(const AST& ast, ChildRange body, std::string_view var, const RecordType& type,
+    std::vector<std::vector<bool>>& used) {
+    for (NodeId id : body) {
+        const Node& stmt = ast[id];
+        if (stmt.kind == NodeKind::Match && stmt.name == var) {
+            for (NodeId arm_id : ast.children(stmt)) {
+                const Node& arm = ast[arm_id];
+                int index = type.find_case(arm.name);
+                std::vector<std::string_view> names = arm_bindings(arm.text);
+                for (size_t k = 0; index >= 0 && k < names.size(); ++k) {
+                    if (names[k] != "_") used[index][k] = true;
+                }
+            }
+        }
+        if (has_body(stmt.kind)) mark_bound(ast, ast.children(stmt), var, type, used);
+    }
+}
+
+std::vector<std::vector<bool>> used_case_fields(const AST& ast, ChildRange body, std::string_view var,
+    const RecordType& type) {
+    std::vector<std::vector<bool>> used;
+    for (const RecordCase& value : type.cases) used.emplace_back(value.fields.size(), false);
+    mark_bound(ast, body, var, type, used);
+    return used;
+}
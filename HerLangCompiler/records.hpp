@@ -0,0 +1,68 @@
+// records.hpp - Record types declared with gentle_type
+#pragma once
+#include "ast.hpp"
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct RecordField {
+    std::string name;
+    NumType type;   // None for String
+};
+
+// One case of a gentle_type with cases, and the fields it carries.
+struct RecordCase {
+    std::string name;
+    std::vector<RecordField> fields;
+};
+
+// A gentle_type. Its fields keep their declaration order, which is also
+// their order in the generated struct and in a record literal. A type
+// with cases has no fields or methods of its own: each value is one of
+// the cases, told apart by its index in `cases`, the tag.
+struct RecordType {
+    std::string name;
+    std::vector<RecordField> fields;
+    std::vector<std::string> methods;
+    std::vector<RecordCase> cases;
+    bool columns = false;   // lists of it are stored one column per field
+
+    // Index of a field, or -1.
+    int field(std::string_view name) const;
+    bool has_method(std::string_view name) const;
+    // Index of a case, or -1.
+    int find_case(std::string_view name) const;
+    bool has_cases() const { return !cases.empty(); }
+};
+
+// The types of one program, in the order they were declared. A type has
+// to be declared before it is used. Everything is copied out of the AST,
+// so a streaming compile can clear the tree between top-level blocks.
+class RecordTable {
+public:
+    // Registers a TypeDef. Throws std::runtime_error for a type declared
+    // twice, a type without fields or cases, a repeated field, method or
+    // case name, a case name already used by another type or case, cases
+    // mixed with fields or methods and a field type other than String,
+    // Number (a whole number) or Float.
+    const RecordType& add(const AST& ast, NodeId def);
+    const RecordType* find(std::string_view name) const;
+    // The type one of whose cases is `name`, or nullptr.
+    const RecordType* of_case(std::string_view name) const;
+
+private:
+    std::map<std::string, RecordType, std::less<>> types_;
+    std::map<std::string, std::string, std::less<>> cases_;   // case -> its type
+};
+
+// Which fields of the record variable `var` a loop body reads, by index:
+// all of them if it calls one of the record's methods, which is given the
+// whole record.
+std::vector<bool> used_fields(const AST& ast, ChildRange body, std::string_view var, const RecordType& type);
+
+// Which fields of each case of `var`, a value of a type with cases, the
+// match_gently statements in a loop body bind, by case and field index.
+std::vector<std::vector<bool>> used_case_fields(const AST& ast, ChildRange body, std::string_view var,
+    const RecordType& type);
@@ -0,0 +1,176 @@
+// stats.cpp - Per-pass timing and resource statistics (hcp --time-passes)
+#include "stats.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+// === Allocation counting ===
+// Replacing the global allocation functions is the only portable way to see
+// every allocation, including those inside the standard library. The cost
+// is one relaxed atomic increment per allocation.
+static std::atomic<uint64_t> allocation_count{ 0 };
+
+void* operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (void* p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+uint64_t heap_allocation_count() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+// === Clocks ===
+double wall_seconds() {
+    using clock = std::chrono::steady_clock;
+    return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+#ifdef _WIN32
+static double filetime_seconds(const FILETIME& ft) {
+    ULARGE_INTEGER v;
+    v.LowPart = ft.dwLowDateTime;
+    v.HighPart = ft.dwHighDateTime;
+    return static_cast<double>(v.QuadPart) * 1e-7;
+}
+#endif
+
+double thread_cpu_seconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) return 0;
+    return filetime_seconds(kernel) + filetime_seconds(user);
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+#endif
+}
+
+double process_cpu_seconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0;
+    return filetime_seconds(kernel) + filetime_seconds(user);
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) return 0;
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+#endif
+}
+
+uint64_t peak_rss_bytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof pmc)) return 0;
+    return static_cast<uint64_t>(pmc.PeakWorkingSetSize);
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// === Collection ===
+void CompileStats::merge(const CompileStats& other) {
+    for (int i = 0; i < kPassCount; ++i) {
+        passes[i].wall += other.passes[i].wall;
+        passes[i].cpu += other.passes[i].cpu;
+    }
+    files += other.files;
+    cache_hits += other.cache_hits;
+    tokens += other.tokens;
+    nodes += other.nodes;
+    bytes_in += other.bytes_in;
+    bytes_out += other.bytes_out;
+}
+
+void PassTimer::start() {
+    if (!stats_ || running_) return;
+    running_ = true;
+    wall_ = wall_seconds();
+    cpu_ = thread_cpu_seconds();
+}
+
+void PassTimer::stop() {
+    if (!stats_ || !running_) return;
+    running_ = false;
+    stats_->add(pass_, wall_seconds() - wall_, thread_cpu_seconds() - cpu_);
+}
+
+// === Reporting ===
+static const char* const pass_keys[kPassCount] = { "read", "lex", "parse", "generate", "write" };
+static const char* const pass_labels[kPassCount] = {
+    "read", "lex + indentation check", "parse", "generate", "write",
+};
+
+static void print_row(std::ostream& out, const char* label, double wall, double cpu) {
+    char line[96];
+    std::snprintf(line, sizeof line, "  %-26s %12.3f %12.3f\n", label, wall * 1e3, cpu * 1e3);
+    out << line;
+}
+
+void report_stats(std::ostream& out, const CompileStats& stats, double wall, double cpu, bool json) {
+    uint64_t allocations = heap_allocation_count();
+    uint64_t rss = peak_rss_bytes();
+
+    if (json) {
+        char num[64];
+        auto ms = [&](double seconds) {
+            std::snprintf(num, sizeof num, "%.3f", seconds * 1e3);
+            return num;
+        };
+
+        out << "{\"files\":" << stats.files << ",\"cache_hits\":" << stats.cache_hits << ",\"passes\":{";
+        for (int i = 0; i < kPassCount; ++i) {
+            if (i) out << ",";
+            out << "\"" << pass_keys[i] << "\":{\"wall_ms\":" << ms(stats.passes[i].wall);
+            out << ",\"cpu_ms\":" << ms(stats.passes[i].cpu) << "}";
+        }
+        out << "},\"total\":{\"wall_ms\":" << ms(wall);
+        out << ",\"cpu_ms\":" << ms(cpu) << "}";
+        out << ",\"tokens\":" << stats.tokens << ",\"nodes\":" << stats.nodes
+            << ",\"bytes_in\":" << stats.bytes_in << ",\"bytes_out\":" << stats.bytes_out
+            << ",\"heap_allocations\":" << allocations << ",\"peak_rss_bytes\":" << rss << "}\n";
+        return;
+    }
+
+    out << "=== hcp pass timings: " << stats.files << " file(s)";
+    if (stats.cache_hits) out << ", " << stats.cache_hits << " from cache";
+    out << " ===\n";
+    char header[96];
+    std::snprintf(header, sizeof header, "  %-26s %12s %12s\n", "pass", "wall (ms)", "cpu (ms)");
+    out << header;
+    for (int i = 0; i < kPassCount; ++i) {
+        print_row(out, pass_labels[i], stats.passes[i].wall, stats.passes[i].cpu);
+    }
+    print_row(out, "total (whole run)", wall, cpu);
+    out << "  tokens: " << stats.tokens << "  nodes: " << stats.nodes
+        << "  bytes in: " << stats.bytes_in << "  bytes out: " << stats.bytes_out << "\n";
+    out << "  heap allocations: " << allocations << "  peak RSS: " << rss / 1024 << " KiB\n";
+}
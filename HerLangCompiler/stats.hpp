@@ -0,0 +1,66 @@
+// stats.hpp - Per-pass timing and resource statistics (hcp --time-passes)
+#pragma once
+#include <cstdint>
+#include <ostream>
+
+enum class Pass : int {
+    Read,       // opening/mapping the source and cache lookup
+    Lex,        // tokenizing, including the fused indentation check
+    Parse,
+    Generate,
+    Write,      // time spent in output system calls and closing the file
+};
+
+constexpr int kPassCount = 5;
+
+struct PassTime {
+    double wall = 0;   // seconds
+    double cpu = 0;    // seconds of CPU time on the measuring thread
+};
+
+struct CompileStats {
+    PassTime passes[kPassCount];
+    uint64_t files = 0;
+    uint64_t cache_hits = 0;
+    uint64_t tokens = 0;
+    uint64_t nodes = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+
+    void add(Pass pass, double wall, double cpu) {
+        passes[static_cast<int>(pass)].wall += wall;
+        passes[static_cast<int>(pass)].cpu += cpu;
+    }
+    void merge(const CompileStats& other);
+};
+
+double wall_seconds();
+double thread_cpu_seconds();
+double process_cpu_seconds();
+// Counts every global operator new since process start.
+uint64_t heap_allocation_count();
+uint64_t peak_rss_bytes();
+
+// Times one pass on the calling thread. A null `stats` turns it into a no-op,
+// so call sites need no conditionals when timing is off.
+class PassTimer {
+public:
+    PassTimer(CompileStats* stats, Pass pass) : stats_(stats), pass_(pass) { start(); }
+    ~PassTimer() { stop(); }
+
+    PassTimer(const PassTimer&) = delete;
+    PassTimer& operator=(const PassTimer&) = delete;
+
+    void start();
+    void stop();
+
+private:
+    CompileStats* stats_;
+    Pass pass_;
+    bool running_ = false;
+    double wall_ = 0;
+    double cpu_ = 0;
+};
+
+// `wall`/`cpu` cover the whole run. Pass times are summed over worker threads.
+void report_stats(std::ostream& out, const CompileStats& stats, double wall, double cpu, bool json);
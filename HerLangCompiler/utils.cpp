@@ -5,28 +5,46 @@
 
 
 std::string trim(const std::string& s) {
-    if (s.empty()) return "";
+    return std::string(trim_view(s));
+}
+
 
+std::vector<std::string> split_lines(const std::string& text) {
+    std::vector<std::string> lines;
+    std::istringstream iss(text);
+    std::string line;
+    while (std::getline(iss, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+std::string_view trim_view(std::string_view s) {
     size_t start = 0;
-    size_t end = s.size() - 1;
+    size_t end = s.size();
 
-    while (start < s.size() && std::isspace(static_cast<unsigned char>(s[start]))) {
+    while (start < end && std::isspace(static_cast<unsigned char>(s[start]))) {
         ++start;
     }
-    while (end >= start && std::isspace(static_cast<unsigned char>(s[end]))) {
+    while (end > start && std::isspace(static_cast<unsigned char>(s[end - 1]))) {
         --end;
     }
 
-    return s.substr(start, end - start + 1);
+    return s.substr(start, end - start);
 }
 
 
-std::vector<std::string> split_lines(const std::string& text) {
-    std::vector<std::string> lines;
-    std::istringstream iss(text);
-    std::string line;
-    while (std::getline(iss, line)) {
-        lines.push_back(line);
+bool next_line(std::string_view text, size_t& pos, std::string_view& line) {
+    if (pos >= text.size()) return false;
+
+    size_t nl = text.find('\n', pos);
+    if (nl == std::string_view::npos) {
+        line = text.substr(pos);
+        pos = text.size();
     }
-    return lines;
+    else {
+        line = text.substr(pos, nl - pos);
+        pos = nl + 1;
+    }
+    return true;
 }
\ No newline at end of file
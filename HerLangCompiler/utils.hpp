@@ -1,9 +1,16 @@
 // utils.hpp
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cctype>
 
 
 std::string trim(const std::string& s);
-std::vector<std::string> split_lines(const std::string& text);
\ No newline at end of file
+std::vector<std::string> split_lines(const std::string& text);
+
+// Non-allocating counterparts used by the lexer and the indentation checker.
+std::string_view trim_view(std::string_view s);
+// Reads the line starting at `pos` (without its '\n') and moves `pos` past it.
+// Returns false once the whole text has been consumed, matching std::getline.
+bool next_line(std::string_view text, size_t& pos, std::string_view& line);
@@ -0,0 +1,5 @@
+// version.hpp - Compiler version, part of every cache key
+#pragma once
+
+// Bump whenever the generated code can change for the same input.
+#define HERLANG_COMPILER_VERSION "0.3.0"
@@ -0,0 +1,445 @@
+// vm.cpp - Interpreter for HerLang bytecode (hcp --run)
+#include "vm.hpp"
+#include "fold.hpp"
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// GCC and Clang can jump straight from one handler to the next through a
+// table of label addresses, giving every handler its own indirect branch.
+// Elsewhere the same handlers become cases of a switch in a loop.
+#if defined(__GNUC__) || defined(__clang__)
+#define HERLANG_COMPUTED_GOTO 1
+#else
+#define HERLANG_COMPUTED_GOTO 0
+#endif
+
+namespace {
+
+constexpr size_t kMaxCallDepth = 100000;
+
+struct Value {
+    // A list's elements are packed in `s` as the matching List opcode
+    // loaded them.
+    enum class Kind : uint8_t { Int, Float, Str, ListStr, ListInt, ListFloat };
+
+    Kind kind = Kind::Int;
+    int64_t i = 0;
+    std::string_view s;   // into the program's string pool
+    double f = 0;
+};
+
+// The compiler only applies integer opcodes to integers and float opcodes
+// to doubles, so handlers read the field they expect without checking.
+inline int64_t wrap(uint64_t v) { return static_cast<int64_t>(v); }
+
+// Same behaviour as the buffer in generated programs, so --run and a
+// compiled binary produce identical output at identical points.
+class Output {
+public:
+    explicit Output(std::FILE* stream) : stream_(stream) {}
+    ~Output() { flush(); }
+
+    void write(const char* data, size_t size) {
+        if (size > sizeof buf_ - used_) {
+            flush();
+            if (size >= sizeof buf_) {
+                std::fwrite(data, 1, size, stream_);
+                return;
+            }
+        }
+        std::memcpy(buf_ + used_, data, size);
+        used_ += size;
+    }
+
+    void write(const Value& v) {
+        if (v.kind == Value::Kind::Str) {
+            write(v.s.data(), v.s.size());
+        }
+        else {
+            char digits[32];
+            auto r = v.kind == Value::Kind::Float
+                ? std::to_chars(digits, digits + sizeof digits, v.f, std::chars_format::general, 6)
+                : std::to_chars(digits, digits + sizeof digits, v.i);
+            write(digits, static_cast<size_t>(r.ptr - digits));
+        }
+    }
+
+    void flush() {
+        if (used_) std::fwrite(buf_, 1, used_, stream_);
+        used_ = 0;
+        std::fflush(stream_);
+    }
+
+private:
+    std::FILE* stream_;
+    char buf_[1 << 16];
+    size_t used_ = 0;
+};
+
+struct Frame {
+    const Instr* ret;
+    uint32_t base;
+    uint32_t size;
+    size_t lists;   // lists made by Pipeline before the call
+};
+
+// Element `index` of a list, a string keeping its constant index in `i`.
+Value element(const BytecodeView& program, const Value& list, size_t index) {
+    const char* at = list.s.data();
+    if (list.kind == Value::Kind::ListStr) {
+        uint32_t k;
+        std::memcpy(&k, at + index * 4, sizeof k);
+        return Value{ Value::Kind::Str, k, program.constant(k) };
+    }
+    if (list.kind == Value::Kind::ListFloat) {
+        double f;
+        std::memcpy(&f, at + index * 8, sizeof f);
+        return Value{ Value::Kind::Float, 0, {}, f };
+    }
+    int64_t i;
+    std::memcpy(&i, at + index * 8, sizeof i);
+    return Value{ Value::Kind::Int, i, {} };
+}
+
+// Takes `x` through one stage: false if a filter drops it, otherwise a
+// calculation leaves its result in `x`.
+bool apply(const PipelineStage& stage, const Value& operand, Value& x) {
+    if (stage.type == NumType::None) {
+        if (x.kind != Value::Kind::Str) return false;
+        std::string_view text = x.s;
+        std::string_view other = operand.s;
+        switch (stage.op) {
+        case StageOp::Equal:      return text == other;
+        case StageOp::NotEqual:   return text != other;
+        case StageOp::Contains:   return text.find(other) != std::string_view::npos;
+        case StageOp::StartsWith: return text.substr(0, other.size()) == other;
+        case StageOp::EndsWith:   return text.size() >= other.size() && text.substr(text.size() - other.size()) == other;
+        default:                  return false;
+        }
+    }
+
+    if (stage.type == NumType::Float) {
+        double a = x.kind == Value::Kind::Float ? x.f : static_cast<double>(x.i);
+        double b = stage.operand == StageOperand::Element ? a : operand.f;
+        switch (stage.op) {
+        case StageOp::Less:         return a < b;
+        case StageOp::LessEqual:    return a <= b;
+        case StageOp::Greater:      return a > b;
+        case StageOp::GreaterEqual: return a >= b;
+        case StageOp::Equal:        return a == b;
+        case StageOp::NotEqual:     return a != b;
+        case StageOp::Add:          x = Value{ Value::Kind::Float, 0, {}, a + b }; return true;
+        case StageOp::Sub:          x = Value{ Value::Kind::Float, 0, {}, a - b }; return true;
+        case StageOp::Mul:          x = Value{ Value::Kind::Float, 0, {}, a * b }; return true;
+        case StageOp::Div:          x = Value{ Value::Kind::Float, 0, {}, a / b }; return true;
+        default:                    return false;
+        }
+    }
+
+    int64_t a = x.i;
+    int64_t b = stage.operand == StageOperand::Element ? a : operand.i;
+    uint64_t ua = static_cast<uint64_t>(a);
+    uint64_t ub = static_cast<uint64_t>(b);
+    switch (stage.op) {
+    case StageOp::Less:         return a < b;
+    case StageOp::LessEqual:    return a <= b;
+    case StageOp::Greater:      return a > b;
+    case StageOp::GreaterEqual: return a >= b;
+    case StageOp::Equal:        return a == b;
+    case StageOp::NotEqual:     return a != b;
+    case StageOp::Add:          x = Value{ Value::Kind::Int, wrap(ua + ub), {} }; return true;
+    case StageOp::Sub:          x = Value{ Value::Kind::Int, wrap(ua - ub), {} }; return true;
+    case StageOp::Mul:          x = Value{ Value::Kind::Int, wrap(ua * ub), {} }; return true;
+    case StageOp::Div:
+        if (b == 0) throw std::runtime_error("division by zero");
+        x = Value{ Value::Kind::Int, b == -1 ? wrap(0 - ua) : a / b, {} };
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Runs a Pipeline: one pass over the source list, taking each element
+// through every stage and packing those that are kept into `storage`, in
+// the layout of the List opcodes' constants. Operands are read once.
+Value pipeline(const BytecodeView& program, const Value* r, std::string_view spec, std::unique_ptr<char[]>& storage) {
+    uint32_t source_reg;
+    std::memcpy(&source_reg, spec.data(), sizeof source_reg);
+    const Value& source = r[source_reg];
+
+    std::vector<PipelineStage> stages((spec.size() - sizeof source_reg) / sizeof(PipelineStage));
+    std::memcpy(stages.data(), spec.data() + sizeof source_reg, stages.size() * sizeof(PipelineStage));
+    std::vector<Value> operands(stages.size());
+    Value::Kind kind = source.kind;
+    for (size_t k = 0; k < stages.size(); ++k) {
+        const PipelineStage& stage = stages[k];
+        if (stage.operand == StageOperand::Register) operands[k] = r[stage.index];
+        else if (stage.operand == StageOperand::Text) operands[k] = Value{ Value::Kind::Str, 0, program.constant(stage.index) };
+        if (stage.op >= StageOp::Add) kind = stage.type == NumType::Float ? Value::Kind::ListFloat : Value::Kind::ListInt;
+    }
+
+    size_t count = 0;
+    if (source.kind == Value::Kind::ListStr) count = source.s.size() / 4;
+    else if (source.kind == Value::Kind::ListInt || source.kind == Value::Kind::ListFloat) count = source.s.size() / 8;
+    size_t width = kind == Value::Kind::ListStr ? 4 : 8;
+    storage.reset(new char[count * width]);
+
+    size_t kept = 0;
+    for (size_t index = 0; index < count; ++index) {
+        Value x = element(program, source, index);
+        bool keep = true;
+        for (size_t k = 0; keep && k < stages.size(); ++k) keep = apply(stages[k], operands[k], x);
+        if (!keep) continue;
+
+        char* at = storage.get() + kept++ * width;
+        if (kind == Value::Kind::ListStr) {
+            auto k = static_cast<uint32_t>(x.i);
+            std::memcpy(at, &k, sizeof k);
+        }
+        else if (kind == Value::Kind::ListFloat) {
+            std::memcpy(at, &x.f, sizeof x.f);
+        }
+        else {
+            std::memcpy(at, &x.i, sizeof x.i);
+        }
+    }
+    return Value{ kind, 0, std::string_view(storage.get(), kept * width) };
+}
+
+} // namespace
+
+void run_bytecode(const BytecodeView& program, std::FILE* stream) {
+    Output out(stream);
+    const Instr* const code = program.code;
+    const BytecodeFunction* const functions = program.functions;
+
+    // One register file for the whole call stack; each frame is a window
+    // starting at `base`. Growing it may move it, so `r` is re-derived
+    // after every call and return.
+    const BytecodeFunction& entry = functions[program.entry];
+    std::vector<Value> registers(entry.registers);
+    std::vector<Frame> frames;
+    // Storage of the lists made by Pipeline, freed when the function that
+    // made them returns; a list never outlives its block.
+    std::vector<std::unique_ptr<char[]>> lists;
+    uint32_t base = 0;
+    uint32_t size = entry.registers;
+    Value* r = registers.data();
+    const Instr* ip = code + entry.entry;
+    const Instr* in;
+
+#if HERLANG_COMPUTED_GOTO
+#define HERLANG_OPCODE_LABEL(name) &&op_##name,
+    static const void* const labels[] = { HERLANG_OPCODES(HERLANG_OPCODE_LABEL) };
+#undef HERLANG_OPCODE_LABEL
+#define CASE(name) op_##name:
+#define DISPATCH() do { in = ip++; goto *labels[static_cast<uint8_t>(in->op)]; } while (0)
+    DISPATCH();
+#else
+#define CASE(name) case Op::name:
+#define DISPATCH() continue
+    for (;;) {
+        in = ip++;
+        switch (in->op) {
+#endif
+
+    CASE(LoadInt) {
+        r[in->a] = Value{ Value::Kind::Int, static_cast<int32_t>(in->b), {} };
+        DISPATCH();
+    }
+    CASE(LoadStr) {
+        r[in->a] = Value{ Value::Kind::Str, 0, program.constant(in->b) };
+        DISPATCH();
+    }
+    CASE(LoadI64) {
+        int64_t v;
+        std::memcpy(&v, program.constant(in->b).data(), sizeof v);
+        r[in->a] = Value{ Value::Kind::Int, v, {} };
+        DISPATCH();
+    }
+    CASE(LoadF64) {
+        double v;
+        std::memcpy(&v, program.constant(in->b).data(), sizeof v);
+        r[in->a] = Value{ Value::Kind::Float, 0, {}, v };
+        DISPATCH();
+    }
+    CASE(Move) {
+        r[in->a] = r[in->b];
+        DISPATCH();
+    }
+    CASE(ToFloat) {
+        r[in->a] = Value{ Value::Kind::Float, 0, {}, static_cast<double>(r[in->b].i) };
+        DISPATCH();
+    }
+    CASE(AddI) {
+        r[in->a].i = wrap(static_cast<uint64_t>(r[in->a].i) + static_cast<uint64_t>(r[in->b].i));
+        DISPATCH();
+    }
+    CASE(SubI) {
+        r[in->a].i = wrap(static_cast<uint64_t>(r[in->a].i) - static_cast<uint64_t>(r[in->b].i));
+        DISPATCH();
+    }
+    CASE(MulI) {
+        r[in->a].i = wrap(static_cast<uint64_t>(r[in->a].i) * static_cast<uint64_t>(r[in->b].i));
+        DISPATCH();
+    }
+    CASE(DivI) {
+        int64_t d = r[in->b].i;
+        if (d == 0) throw std::runtime_error("division by zero");
+        int64_t& v = r[in->a].i;
+        v = d == -1 ? wrap(0 - static_cast<uint64_t>(v)) : v / d;
+        DISPATCH();
+    }
+    CASE(AddF) {
+        r[in->a].f += r[in->b].f;
+        DISPATCH();
+    }
+    CASE(SubF) {
+        r[in->a].f -= r[in->b].f;
+        DISPATCH();
+    }
+    CASE(MulF) {
+        r[in->a].f *= r[in->b].f;
+        DISPATCH();
+    }
+    CASE(DivF) {
+        r[in->a].f /= r[in->b].f;
+        DISPATCH();
+    }
+    CASE(Print) {
+        out.write(r[in->a]);
+        DISPATCH();
+    }
+    CASE(PrintStr) {
+        std::string_view text = program.constant(in->b);
+        out.write(text.data(), text.size());
+        DISPATCH();
+    }
+    CASE(Flush) {
+        out.flush();
+        DISPATCH();
+    }
+    CASE(Sleep) {
+        out.flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(in->b));
+        DISPATCH();
+    }
+    CASE(ListStr) {
+        r[in->a] = Value{ Value::Kind::ListStr, 0, program.constant(in->b) };
+        DISPATCH();
+    }
+    CASE(ListI64) {
+        r[in->a] = Value{ Value::Kind::ListInt, 0, program.constant(in->b) };
+        DISPATCH();
+    }
+    CASE(ListF64) {
+        r[in->a] = Value{ Value::Kind::ListFloat, 0, program.constant(in->b) };
+        DISPATCH();
+    }
+    CASE(Pipeline) {
+        lists.emplace_back();
+        r[in->a] = pipeline(program, r, program.constant(in->b), lists.back());
+        DISPATCH();
+    }
+    CASE(Jump) {
+        ip = code + in->b;
+        DISPATCH();
+    }
+    CASE(Loop) {
+        if (r[in->a].i > 0) {
+            --r[in->a].i;
+            ip = code + in->b;
+        }
+        DISPATCH();
+    }
+    CASE(Next) {
+        Value* it = r + in->a;
+        std::string_view items = it[0].s;
+        auto index = static_cast<uint64_t>(it[1].i);
+        bool more = false;
+        switch (it[0].kind) {
+        case Value::Kind::ListStr:
+            if ((more = index < items.size() / 4)) {
+                uint32_t k;
+                std::memcpy(&k, items.data() + index * 4, sizeof k);
+                it[2] = Value{ Value::Kind::Str, 0, program.constant(k) };
+            }
+            break;
+        case Value::Kind::ListInt:
+            if ((more = index < items.size() / 8)) {
+                int64_t v;
+                std::memcpy(&v, items.data() + index * 8, sizeof v);
+                it[2] = Value{ Value::Kind::Int, v, {} };
+            }
+            break;
+        case Value::Kind::ListFloat:
+            if ((more = index < items.size() / 8)) {
+                double v;
+                std::memcpy(&v, items.data() + index * 8, sizeof v);
+                it[2] = Value{ Value::Kind::Float, 0, {}, v };
+            }
+            break;
+        default:
+            break;
+        }
+        if (more) {
+            ++it[1].i;
+            ip = code + in->b;
+        }
+        DISPATCH();
+    }
+    CASE(Switch) {
+        std::string_view table = program.constant(in->b);
+        auto index = static_cast<uint64_t>(r[in->a].i);
+        if (index < table.size() / 4) {
+            uint32_t target;
+            std::memcpy(&target, table.data() + index * 4, sizeof target);
+            ip = code + target;
+        }
+        DISPATCH();
+    }
+    CASE(Call) {
+        if (frames.size() >= kMaxCallDepth) {
+            throw std::runtime_error("call stack overflow (more than " + std::to_string(kMaxCallDepth) +
+                " nested calls)");
+        }
+        const BytecodeFunction& callee = functions[in->b];
+
+        frames.push_back({ ip, base, size, lists.size() });
+        uint32_t args = base + in->a;
+        base += size;
+        size = callee.registers;
+        if (registers.size() < base + size) registers.resize(base + size);
+        r = registers.data() + base;
+        for (uint16_t k = 0; k < callee.params; ++k) r[k] = registers[args + k];
+        ip = code + callee.entry;
+        DISPATCH();
+    }
+    CASE(Return) {
+        if (frames.empty()) goto done;
+        const Frame& caller = frames.back();
+        ip = caller.ret;
+        base = caller.base;
+        size = caller.size;
+        lists.resize(caller.lists);
+        frames.pop_back();
+        r = registers.data() + base;
+        DISPATCH();
+    }
+
+#if !HERLANG_COMPUTED_GOTO
+        }
+    }
+#endif
+#undef CASE
+#undef DISPATCH
+
+done:
+    out.flush();
+}
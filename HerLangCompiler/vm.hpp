@@ -0,0 +1,15 @@
+// vm.hpp - Interpreter for HerLang bytecode (hcp --run)
+#pragma once
+#include "bytecode.hpp"
+#include <cstdio>
+
+// Runs `program` from its start block, writing through a 64 KiB buffer to
+// `out` with the flushes the compiler placed in the code. The program must
+// be well formed: produced by compile_bytecode or accepted by load_hbc.
+// Throws std::runtime_error if calls nest too deeply or an integer is
+// divided by zero; output produced up to that point is flushed.
+void run_bytecode(const BytecodeView& program, std::FILE* out = stdout);
+
+inline void run_bytecode(const BytecodeProgram& program, std::FILE* out = stdout) {
+    run_bytecode(program.view(), out);
+}
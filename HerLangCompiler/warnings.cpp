@@ -1,60 +1,71 @@
 // warnings.cpp - Indentation warning analyzer
 #include "warnings.hpp"
+#include "keywords.hpp"
 #include "utils.hpp"
-#include <sstream>
-#include <iostream>
-#include <stack>
+#include <ostream>
 
-void check_indentation(const std::string& source) {
-    std::istringstream in(source);
-    std::string line;
-    int lineno = 1;
-
-    std::stack<int> indent_stack;
-
-    while (std::getline(in, line)) {
-        std::string trimmed = trim(line);
-        if (trimmed.empty() || trimmed[0] == '#') {
-            lineno++;
-            continue;
-        }
+void IndentationChecker::line(int lineno, int indent, std::string_view trimmed) {
+    const KeywordInfo* kw = leading_keyword(trimmed);
+    uint8_t flags = kw ? kw->flags : 0;
 
-        int indent = 0;
-        for (char c : line) {
-            if (c == ' ') indent++;
-            else break;
+    if (trimmed == "end") {
+        if (indent_stack_.empty()) {
+            diag_ << "[Warning] Line " << lineno << ": 'end' without matching block start.\n";
         }
-
-        if (trimmed == "end") {
-            if (indent_stack.empty()) {
-                std::cerr << "[Warning] Line " << lineno << ": 'end' without matching block start.\n";
-            }
-            else {
-                int expected_indent = indent_stack.top();
-                if (indent != expected_indent) {
-                    std::cerr << "[Warning] Line " << lineno << ": 'end' indentation mismatch. Expected "
-                        << expected_indent << " spaces but got " << indent << ".\n";
-                }
-                indent_stack.pop();
+        else {
+            int expected_indent = indent_stack_.top();
+            if (indent != expected_indent) {
+                diag_ << "[Warning] Line " << lineno << ": 'end' indentation mismatch. Expected "
+                    << expected_indent << " spaces but got " << indent << ".\n";
             }
+            indent_stack_.pop();
         }
-        else if (trimmed.find("function") == 0 || trimmed.find("start:") == 0 ||
-            trimmed.find("if") == 0 || trimmed.find("elif") == 0 || trimmed.find("else") == 0) {
-            indent_stack.push(indent);
+    }
+    else if (flags & OpensBlock) {
+        indent_stack_.push(indent);
+    }
+    else if (flags & ContinuesBlock) {
+        // elif/else share the 'end' of their if, so they line up with it.
+        if (!indent_stack_.empty() && indent != indent_stack_.top()) {
+            diag_ << "[Warning] Line " << lineno << ": '" << kw->spelling << "' indentation mismatch. Expected "
+                << indent_stack_.top() << " spaces but got " << indent << ".\n";
         }
-        else {
-            if (!indent_stack.empty()) {
-                int expected_indent = indent_stack.top();
-                if (indent <= expected_indent) {
-                    std::cerr << "[Warning] Line " << lineno << ": Inconsistent indentation. Expected greater than "
-                        << expected_indent << " spaces but got " << indent << ".\n";
-                }
+    }
+    else {
+        if (!indent_stack_.empty()) {
+            int expected_indent = indent_stack_.top();
+            if (indent <= expected_indent) {
+                diag_ << "[Warning] Line " << lineno << ": Inconsistent indentation. Expected greater than "
+                    << expected_indent << " spaces but got " << indent << ".\n";
             }
         }
-        lineno++;
     }
+}
 
-    if (!indent_stack.empty()) {
-        std::cerr << "[Warning] EOF: Some blocks not closed properly (missing 'end').\n";
+void IndentationChecker::finish() {
+    if (!indent_stack_.empty()) {
+        diag_ << "[Warning] EOF: Some blocks not closed properly (missing 'end').\n";
     }
 }
+
+void check_indentation(std::string_view source, std::ostream& diag) {
+    IndentationChecker checker(diag);
+    size_t pos = 0;
+    std::string_view line;
+    int lineno = 1;
+
+    while (next_line(source, pos, line)) {
+        std::string_view trimmed = trim_view(line);
+        if (!trimmed.empty() && trimmed[0] != '#') {
+            int indent = 0;
+            for (char c : line) {
+                if (c == ' ') indent++;
+                else break;
+            }
+            checker.line(lineno, indent, trimmed);
+        }
+        lineno++;
+    }
+
+    checker.finish();
+}
@@ -1,5 +1,25 @@
 // warnings.hpp
 #pragma once
-#include <string>
+#include <iostream>
+#include <stack>
+#include <string_view>
 
-void check_indentation(const std::string& source);
\ No newline at end of file
+// Indentation analysis, fed one line at a time. The lexer drives it while
+// it scans each line, so checking costs no extra pass over the source.
+class IndentationChecker {
+public:
+    explicit IndentationChecker(std::ostream& diag = std::cerr) : diag_(diag) {}
+
+    // `indent` is the number of leading spaces; `trimmed` is the line without
+    // surrounding whitespace. Blank and comment lines are not reported.
+    void line(int lineno, int indent, std::string_view trimmed);
+    // Reports blocks still open at end of input.
+    void finish();
+
+private:
+    std::ostream& diag_;
+    std::stack<int> indent_stack_;
+};
+
+// Standalone check of a whole source buffer.
+void check_indentation(std::string_view source, std::ostream& diag = std::cerr);
@@ -0,0 +1,326 @@
+// frontend_bench.cpp - Throughput benchmarks for lex, parse and generate_cpp
+#include "program_generator.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "generator.hpp"
+#include "mapped_file.hpp"
+#include "stats.hpp"
+#include "version.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Benchmark {
+    std::string name;
+    ProgramShape shape;
+};
+
+struct PhaseResult {
+    double seconds = 0;   // best of all iterations
+    double mb_per_s = 0;
+    double stmts_per_s = 0;
+};
+
+struct Result {
+    std::string name;
+    ProgramShape shape;
+    size_t bytes = 0;
+    size_t statements = 0;
+    PhaseResult lex, parse, generate;
+};
+
+// Discards generated code without allocating, so generate_cpp is measured
+// on its own rather than together with string growth or file I/O.
+class NullBuffer : public std::streambuf {
+public:
+    size_t written = 0;
+
+protected:
+    int_type overflow(int_type ch) override {
+        ++written;
+        setp(buf_, buf_ + sizeof buf_);
+        return traits_type::not_eof(ch);
+    }
+    std::streamsize xsputn(const char*, std::streamsize n) override {
+        written += static_cast<size_t>(n);
+        return n;
+    }
+
+private:
+    char buf_[4096];
+};
+
+size_t count_statements(const AST& ast) {
+    size_t count = 0;
+    for (NodeId id = 0; id < ast.node_count(); ++id) {
+        switch (ast[id].kind) {
+        case NodeKind::Say:
+        case NodeKind::Set:
+        case NodeKind::FunctionCall:
+        case NodeKind::FunctionDef:
+        case NodeKind::StartBlock:
+            ++count;
+            break;
+        default:
+            break;
+        }
+    }
+    return count;
+}
+
+template <typename Fn>
+double best_time(int iterations, Fn&& fn) {
+    double best = 1e300;
+    for (int i = 0; i < iterations; ++i) {
+        double start = wall_seconds();
+        fn();
+        best = std::min(best, wall_seconds() - start);
+    }
+    return best;
+}
+
+PhaseResult rate(double seconds, size_t bytes, size_t statements) {
+    PhaseResult r;
+    r.seconds = seconds;
+    if (seconds > 0) {
+        r.mb_per_s = static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds;
+        r.stmts_per_s = static_cast<double>(statements) / seconds;
+    }
+    return r;
+}
+
+Result run(const std::string& name, const ProgramShape& shape, std::string_view source, int iterations) {
+    Result result;
+    result.name = name;
+    result.shape = shape;
+    result.bytes = source.size();
+
+    std::vector<Token> tokens = lex(source);
+    AST ast = parse(tokens);
+    result.statements = count_statements(ast);
+
+    double lex_time = best_time(iterations, [&]() {
+        std::vector<Token> t = lex(source);
+        if (t.size() != tokens.size()) std::abort();
+    });
+    double parse_time = best_time(iterations, [&]() {
+        AST a = parse(tokens);
+        if (a.node_count() != ast.node_count()) std::abort();
+    });
+    double generate_time = best_time(iterations, [&]() {
+        NullBuffer sink;
+        std::ostream out(&sink);
+        generate_cpp(ast, out);
+    });
+
+    result.lex = rate(lex_time, result.bytes, result.statements);
+    result.parse = rate(parse_time, result.bytes, result.statements);
+    result.generate = rate(generate_time, result.bytes, result.statements);
+    return result;
+}
+
+void print_table(const std::vector<Result>& results) {
+    std::printf("%-14s %9s %9s | %20s | %20s | %20s\n", "benchmark", "KiB", "stmts",
+        "lex MB/s  Mstmt/s", "parse MB/s  Mstmt/s", "gen MB/s  Mstmt/s");
+    for (const auto& r : results) {
+        std::printf("%-14s %9zu %9zu | %9.1f %10.2f | %9.1f %10.2f | %9.1f %10.2f\n",
+            r.name.c_str(), r.bytes / 1024, r.statements,
+            r.lex.mb_per_s, r.lex.stmts_per_s / 1e6,
+            r.parse.mb_per_s, r.parse.stmts_per_s / 1e6,
+            r.generate.mb_per_s, r.generate.stmts_per_s / 1e6);
+    }
+}
+
+void write_phase(std::ostream& out, const char* key, const PhaseResult& p) {
+    char buf[160];
+    std::snprintf(buf, sizeof buf, "\"%s\":{\"seconds\":%.6f,\"mb_per_s\":%.3f,\"stmts_per_s\":%.1f}",
+        key, p.seconds, p.mb_per_s, p.stmts_per_s);
+    out << buf;
+}
+
+// One result per line keeps the file diff-friendly and lets --compare read
+// it back without a JSON library.
+void write_json(std::ostream& out, const std::vector<Result>& results) {
+    out << "{\"compiler_version\":\"" << HERLANG_COMPILER_VERSION << "\",\"results\":[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        out << "{\"name\":\"" << r.name << "\",\"shape\":{\"functions\":" << r.shape.functions
+            << ",\"statements\":" << r.shape.statements << ",\"string_length\":" << r.shape.string_length
+            << ",\"nesting\":" << r.shape.nesting << ",\"seed\":" << r.shape.seed << "}"
+            << ",\"bytes\":" << r.bytes << ",\"statements\":" << r.statements << ",";
+        write_phase(out, "lex", r.lex);
+        out << ",";
+        write_phase(out, "parse", r.parse);
+        out << ",";
+        write_phase(out, "generate", r.generate);
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]}\n";
+}
+
+// Pulls "<phase>":{..."mb_per_s":X...} out of one line written by write_json.
+double read_rate(const std::string& line, const std::string& phase) {
+    size_t at = line.find("\"" + phase + "\":{");
+    if (at == std::string::npos) return 0;
+    at = line.find("\"mb_per_s\":", at);
+    if (at == std::string::npos) return 0;
+    return std::strtod(line.c_str() + at + 11, nullptr);
+}
+
+void compare(const std::string& path, const std::vector<Result>& results) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open baseline: " << path << "\n";
+        return;
+    }
+
+    std::map<std::string, std::string> baseline;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t at = line.find("{\"name\":\"");
+        if (at == std::string::npos) continue;
+        size_t end = line.find('"', at + 9);
+        baseline[line.substr(at + 9, end - at - 9)] = line;
+    }
+
+    std::printf("\nchange vs %s (MB/s, positive is faster)\n", path.c_str());
+    std::printf("%-14s %10s %10s %10s\n", "benchmark", "lex", "parse", "generate");
+    for (const auto& r : results) {
+        auto it = baseline.find(r.name);
+        if (it == baseline.end()) {
+            std::printf("%-14s %10s\n", r.name.c_str(), "(new)");
+            continue;
+        }
+        auto delta = [&](const char* phase, double now) {
+            double before = read_rate(it->second, phase);
+            return before > 0 ? (now / before - 1.0) * 100.0 : 0.0;
+        };
+        std::printf("%-14s %+9.1f%% %+9.1f%% %+9.1f%%\n", r.name.c_str(),
+            delta("lex", r.lex.mb_per_s), delta("parse", r.parse.mb_per_s),
+            delta("generate", r.generate.mb_per_s));
+    }
+}
+
+std::vector<Benchmark> default_suite(unsigned scale) {
+    auto shape = [&](unsigned functions, unsigned statements, unsigned string_length, unsigned nesting) {
+        ProgramShape s;
+        s.functions = functions * scale;
+        s.statements = statements;
+        s.string_length = string_length;
+        s.nesting = nesting;
+        return s;
+    };
+    return {
+        { "small",        shape(100, 5, 16, 1) },
+        { "many_funcs",   shape(20000, 4, 16, 1) },
+        { "long_bodies",  shape(500, 400, 24, 1) },
+        { "long_strings", shape(2000, 10, 400, 1) },
+        { "deep_chains",  shape(5000, 8, 24, 50) },
+    };
+}
+
+void print_usage() {
+    std::cerr << "Usage: hcp_bench [options]\n"
+        << "\n"
+        << "Without a shape option, runs the default suite.\n"
+        << "  --functions N       function definitions in the generated program\n"
+        << "  --statements N      statements per function\n"
+        << "  --string-length N   characters per string literal\n"
+        << "  --nesting N         depth of call chains\n"
+        << "  --seed N            generator seed (default 1)\n"
+        << "  --scale N           multiply the default suite's function counts by N\n"
+        << "  --input file.herc   benchmark an existing source file instead\n"
+        << "  --iterations N      runs per phase; the best is reported (default 5)\n"
+        << "  --emit file.herc    write the generated program and exit\n"
+        << "  --json file         save results as JSON\n"
+        << "  --compare file      compare against results saved with --json\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    ProgramShape custom;
+    bool have_custom = false;
+    unsigned scale = 1;
+    int iterations = 5;
+    std::string input, emit, json, baseline;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            print_usage();
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            print_usage();
+            return 1;
+        }
+        std::string value = argv[++i];
+        unsigned long n = std::strtoul(value.c_str(), nullptr, 10);
+
+        if (arg == "--functions") { custom.functions = static_cast<unsigned>(n); have_custom = true; }
+        else if (arg == "--statements") { custom.statements = static_cast<unsigned>(n); have_custom = true; }
+        else if (arg == "--string-length") { custom.string_length = static_cast<unsigned>(n); have_custom = true; }
+        else if (arg == "--nesting") { custom.nesting = static_cast<unsigned>(n); have_custom = true; }
+        else if (arg == "--seed") { custom.seed = n; have_custom = true; }
+        else if (arg == "--scale") scale = std::max(1u, static_cast<unsigned>(n));
+        else if (arg == "--iterations") iterations = std::max(1, static_cast<int>(n));
+        else if (arg == "--input") input = value;
+        else if (arg == "--emit") emit = value;
+        else if (arg == "--json") json = value;
+        else if (arg == "--compare") baseline = value;
+        else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (!emit.empty()) {
+        std::ofstream out(emit, std::ios::binary);
+        out << generate_program(custom);
+        return out ? 0 : 1;
+    }
+
+    std::vector<Result> results;
+    if (!input.empty()) {
+        MappedFile file;
+        if (!file.open(input)) {
+            std::cerr << "Cannot open input file: " << input << "\n";
+            return 1;
+        }
+        results.push_back(run(input, ProgramShape{}, file.view(), iterations));
+    }
+    else {
+        std::vector<Benchmark> suite;
+        if (have_custom) suite.push_back({ "custom", custom });
+        else suite = default_suite(scale);
+
+        for (const auto& b : suite) {
+            std::string source = generate_program(b.shape);
+            results.push_back(run(b.name, b.shape, source, iterations));
+        }
+    }
+
+    print_table(results);
+
+    if (!json.empty()) {
+        std::ofstream out(json);
+        write_json(out, results);
+        if (!out) {
+            std::cerr << "Cannot write results: " << json << "\n";
+            return 1;
+        }
+    }
+    if (!baseline.empty()) compare(baseline, results);
+    return 0;
+}
@@ -0,0 +1,117 @@
+// program_generator.cpp - Deterministic synthetic .herc programs for benchmarks
+#include "program_generator.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// splitmix64: tiny, fast and fully specified.
+struct Rng {
+    uint64_t state;
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    unsigned below(unsigned n) { return n ? static_cast<unsigned>(next() % n) : 0; }
+};
+
+const char* const words[] = {
+    "gentle", "code", "her", "world", "bloom", "kind", "light", "brave",
+    "编程", "很美", "也属于你", "温柔", "你好",
+};
+
+void append_text(std::string& out, Rng& rng, unsigned length) {
+    size_t start = out.size();
+    while (out.size() - start < length) {
+        if (out.size() != start) out += ' ';
+        out += words[rng.below(sizeof words / sizeof words[0])];
+    }
+}
+
+std::string function_name(unsigned i) {
+    return "f" + std::to_string(i);
+}
+
+} // namespace
+
+std::string generate_program(const ProgramShape& shape) {
+    Rng rng{ shape.seed };
+    std::string out;
+    out.reserve(static_cast<size_t>(shape.functions) * shape.statements * (shape.string_length + 16));
+
+    unsigned depth = std::max(shape.nesting, 1u);
+
+    for (unsigned f = 0; f < shape.functions; ++f) {
+        // Chains call backwards so every callee is defined before its caller;
+        // the last function of a chain is its entry point and is called from
+        // start: without an argument, every other one takes a parameter.
+        bool entry = (f + 1) % depth == 0 || f + 1 == shape.functions;
+        bool has_param = !entry;
+        out += "function " + function_name(f);
+        if (has_param) out += " who";
+        out += ":\n";
+
+        for (unsigned s = 0; s < shape.statements; ++s) {
+            out += "    ";
+            switch (rng.below(has_param ? 6 : 5)) {
+            case 0:
+                out += "set counter";
+                out += std::to_string(s);
+                break;
+            case 1:
+                out += "say \"";
+                append_text(out, rng, shape.string_length);
+                out += "\" end=\" \"";
+                break;
+            case 5:
+                out += "say \"";
+                append_text(out, rng, shape.string_length / 2);
+                out += "\", who";
+                break;
+            default:
+                out += "say \"";
+                append_text(out, rng, shape.string_length);
+                out += "\"";
+                break;
+            }
+            out += '\n';
+        }
+
+        if (f % depth != 0) {
+            out += "    " + function_name(f - 1) + " \"";
+            append_text(out, rng, shape.string_length / 2);
+            out += "\"\n";
+        }
+        out += "end\n\n";
+    }
+
+    std::vector<std::string> entries;
+    for (unsigned f = 0; f < shape.functions; ++f) {
+        if ((f + 1) % depth == 0 || f + 1 == shape.functions) entries.push_back(function_name(f));
+    }
+
+    // The parser caps a block at 10000 statements, so large programs reach
+    // their entry points through batch functions of at most 1000 calls each.
+    const size_t batch = 1000;
+    while (entries.size() > batch) {
+        std::vector<std::string> batches;
+        for (size_t i = 0; i < entries.size(); i += batch) {
+            std::string name = "batch" + std::to_string(batches.size()) + "_" + std::to_string(entries.size());
+            out += "function " + name + ":\n";
+            for (size_t j = i; j < std::min(i + batch, entries.size()); ++j) {
+                out += "    " + entries[j] + "\n";
+            }
+            out += "end\n\n";
+            batches.push_back(std::move(name));
+        }
+        entries = std::move(batches);
+    }
+
+    out += "start:\n";
+    for (const auto& entry : entries) out += "    " + entry + "\n";
+    out += "end\n";
+    return out;
+}
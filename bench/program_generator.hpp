@@ -0,0 +1,16 @@
+// program_generator.hpp - Deterministic synthetic .herc programs for benchmarks
+#pragma once
+#include <cstdint>
+#include <string>
+
+struct ProgramShape {
+    unsigned functions = 1000;     // function definitions
+    unsigned statements = 10;      // statements per function body
+    unsigned string_length = 24;   // characters per string literal
+    unsigned nesting = 1;          // depth of the call chains started from start:
+    uint64_t seed = 1;
+};
+
+// The same shape always yields byte-identical source on every platform:
+// the generator uses its own PRNG rather than <random> distributions.
+std::string generate_program(const ProgramShape& shape);
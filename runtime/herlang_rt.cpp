@@ -0,0 +1,364 @@
+// herlang_rt.cpp - Runtime library linked into every generated HerLang program
+
+#include "herlang_rt.hpp"
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace herlang::runtime {
+
+namespace {
+
+class Buffer {
+public:
+    ~Buffer() { flush(); }
+
+    void write(const char* data, std::size_t size) {
+        if (size > sizeof buf_ - used_) {
+            flush();
+            if (size >= sizeof buf_) {
+                std::fwrite(data, 1, size, stdout);
+                return;
+            }
+        }
+        std::memcpy(buf_ + used_, data, size);
+        used_ += size;
+    }
+
+    void flush() {
+        if (used_) std::fwrite(buf_, 1, used_, stdout);
+        used_ = 0;
+        std::fflush(stdout);
+    }
+
+private:
+    char buf_[1 << 16];
+    std::size_t used_ = 0;
+};
+
+// Zero-initialized before any code runs, and destroyed (flushing whatever
+// is left) after main() returns or exit() is called.
+Buffer buffer;
+
+// While spawned blocks are alive they add their output to `buffer` under
+// this lock, and the main thread takes it too. Otherwise the main thread
+// is the only writer and skips it.
+std::mutex output_mutex;
+std::atomic<std::size_t> live_blocks{ 0 };
+
+bool shared() {
+    return live_blocks.load(std::memory_order_acquire) != 0;
+}
+
+// What one spawned block prints, kept on its own thread until publish().
+class BlockOutput {
+public:
+    void write(const char* data, std::size_t size) {
+        if (size > sizeof buf_ - used_) {
+            publish();
+            if (size >= sizeof buf_) {
+                std::lock_guard<std::mutex> lock(output_mutex);
+                buffer.write(data, size);
+                return;
+            }
+        }
+        std::memcpy(buf_ + used_, data, size);
+        used_ += size;
+    }
+
+    void publish() {
+        if (!used_) return;
+        std::lock_guard<std::mutex> lock(output_mutex);
+        buffer.write(buf_, used_);
+        used_ = 0;
+    }
+
+private:
+    char buf_[1 << 14];
+    std::size_t used_ = 0;
+};
+
+// Set on a thread while it runs a spawned block.
+thread_local BlockOutput* block_output = nullptr;
+
+// Ends the program with an error. From a spawned block other threads may
+// still be writing, so it leaves without running static destructors.
+[[noreturn]] void fail(const char* message) {
+    bool spawned = block_output != nullptr;
+    flush();
+    std::fputs(message, stderr);
+    if (spawned) std::_Exit(1);
+    std::exit(1);
+}
+
+// The longest a number piece prints as: 20 digits and a sign, or a double
+// such as -1.23457e-308.
+constexpr std::size_t kNumberBytes = 24;
+
+// Writes a number piece at `at`, which has room for kNumberBytes, and
+// returns the end of its digits. Doubles get six significant digits, as
+// std::cout prints them by default.
+char* format_number(const Piece& piece, char* at) {
+    char* end = at + kNumberBytes;
+    if (piece.kind == Piece::Int) return std::to_chars(at, end, piece.i).ptr;
+    if (piece.kind == Piece::Uint) return std::to_chars(at, end, piece.u).ptr;
+    return std::to_chars(at, end, piece.f, std::chars_format::general, 6).ptr;
+}
+
+std::string_view view(Str s) {
+    return { s.ptr, s.len };
+}
+
+// Worker threads for parallel_for and spawned blocks, one per CPU core
+// besides the caller's. They sleep between jobs and are never joined: the
+// pool lives until the process exits. The calls of a parallel_for job come
+// first, as its caller is waiting. There is always at least one worker,
+// even on a single core, so spawned blocks run alongside the thread that
+// spawned them rather than only once it waits for them.
+class Pool {
+public:
+    using Task = void (*)(void*, std::size_t);
+
+    static Pool& get() {
+        static Pool* pool = new Pool;
+        return *pool;
+    }
+
+    Pool() {
+        unsigned cores = std::thread::hardware_concurrency();
+        unsigned workers = cores > 1 ? cores - 1 : 1;
+        for (unsigned i = 0; i < workers; ++i) std::thread([this] { work(); }).detach();
+    }
+
+    void run(std::size_t count, Task task, void* context) {
+        std::lock_guard<std::mutex> one_job(running_);
+        std::unique_lock<std::mutex> lock(mutex_);
+        task_ = task;
+        context_ = context;
+        count_ = count;
+        next_ = 0;
+        done_ = 0;
+        wake_.notify_all();
+        take_tasks(lock);
+        finished_.wait(lock, [this] { return done_ == count_; });
+    }
+
+    void spawn(std::size_t* pending, void* task, void (*run)(void*)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++*pending;
+        live_blocks.fetch_add(1, std::memory_order_acq_rel);
+        blocks_.push_back({ pending, task, run });
+        wake_.notify_one();
+        settled_.notify_all();
+    }
+
+    // Runs waiting blocks, its own group's or not, until none of the
+    // group's are left; a block may spawn more into the same group.
+    void wait(std::size_t* pending) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (*pending) {
+            if (!blocks_.empty()) run_block(lock);
+            else settled_.wait(lock);
+        }
+    }
+
+private:
+    struct Block {
+        std::size_t* pending;
+        void* task;
+        void (*run)(void*);
+    };
+
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait(lock, [this] { return next_ < count_ || !blocks_.empty(); });
+            if (next_ < count_) take_tasks(lock);
+            else run_block(lock);
+        }
+    }
+
+    // Runs the oldest waiting block. Its output is published before the
+    // group hears it has finished, so wait() returns with it written.
+    void run_block(std::unique_lock<std::mutex>& lock) {
+        Block block = blocks_.front();
+        blocks_.pop_front();
+        lock.unlock();
+
+        BlockOutput output;
+        BlockOutput* outer = block_output;
+        block_output = &output;
+        block.run(block.task);
+        output.publish();
+        block_output = outer;
+
+        lock.lock();
+        if (--*block.pending == 0) settled_.notify_all();
+        live_blocks.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    // Runs unclaimed calls of the current job until none are left.
+    void take_tasks(std::unique_lock<std::mutex>& lock) {
+        while (next_ < count_) {
+            std::size_t index = next_++;
+            Task task = task_;
+            void* context = context_;
+            lock.unlock();
+            task(context, index);
+            lock.lock();
+            if (++done_ == count_) finished_.notify_all();
+        }
+    }
+
+    std::mutex running_;   // one job at a time
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable finished_;
+    std::condition_variable settled_;   // a block finished or was spawned
+    std::deque<Block> blocks_;
+    Task task_ = nullptr;
+    void* context_ = nullptr;
+    std::size_t count_ = 0;
+    std::size_t next_ = 0;
+    std::size_t done_ = 0;
+};
+
+} // namespace
+
+void write(const char* data, std::size_t size) {
+    if (block_output) {
+        block_output->write(data, size);
+        return;
+    }
+    if (!shared()) {
+        buffer.write(data, size);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(output_mutex);
+    buffer.write(data, size);
+}
+
+void say(const Piece* pieces, std::size_t count) {
+    std::size_t size = 0;
+    for (std::size_t k = 0; k < count; ++k) {
+        const Piece& piece = pieces[k];
+        if (piece.kind == Piece::Text) size += piece.text.len;
+        else if (piece.kind == Piece::CText) size += std::strlen(piece.c_text);
+        else size += kNumberBytes;
+    }
+
+    char line[1024];
+    if (size > sizeof line) {
+        for (std::size_t k = 0; k < count; ++k) {
+            const Piece& piece = pieces[k];
+            if (piece.kind == Piece::Text) {
+                write(piece.text.ptr, piece.text.len);
+            }
+            else if (piece.kind == Piece::CText) {
+                write(piece.c_text, std::strlen(piece.c_text));
+            }
+            else {
+                char digits[kNumberBytes];
+                write(digits, static_cast<std::size_t>(format_number(piece, digits) - digits));
+            }
+        }
+        return;
+    }
+
+    char* at = line;
+    for (std::size_t k = 0; k < count; ++k) {
+        const Piece& piece = pieces[k];
+        switch (piece.kind) {
+        case Piece::Text:
+            std::memcpy(at, piece.text.ptr, piece.text.len);
+            at += piece.text.len;
+            break;
+        case Piece::CText:
+            for (const char* c = piece.c_text; *c; ++c) *at++ = *c;
+            break;
+        default: at = format_number(piece, at); break;
+        }
+    }
+    write(line, static_cast<std::size_t>(at - line));
+}
+
+void flush() {
+    if (block_output) block_output->publish();
+    if (!shared()) {
+        buffer.flush();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(output_mutex);
+    buffer.flush();
+}
+
+void pause(unsigned milliseconds) {
+    flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+}
+
+void TaskGroup::start(void* task, void (*run)(void* task)) {
+    Pool::get().spawn(&pending_, task, run);
+}
+
+// With no block alive anywhere, none of this group's can be pending, and
+// the pool need not be started at all.
+void TaskGroup::wait() {
+    if (!shared()) return;
+    Pool::get().wait(&pending_);
+}
+
+bool equals(Str text, Str other) {
+    return view(text) == view(other);
+}
+
+bool contains(Str text, Str part) {
+    return view(text).find(view(part)) != std::string_view::npos;
+}
+
+bool starts_with(Str text, Str prefix) {
+    return view(text).substr(0, prefix.len) == view(prefix);
+}
+
+bool ends_with(Str text, Str suffix) {
+    return text.len >= suffix.len && view(text).substr(text.len - suffix.len) == view(suffix);
+}
+
+void parallel_for(std::size_t count, void (*task)(void* context, std::size_t index), void* context) {
+    Pool::get().run(count, task, context);
+}
+
+void* allocate(std::size_t bytes) {
+    void* block = std::malloc(bytes);
+    if (!block && bytes) fail("[Error] out of memory\n");
+    return block;
+}
+
+void release(void* block) {
+    std::free(block);
+}
+
+void division_by_zero() {
+    fail("[Error] division by zero\n");
+}
+
+void start() {
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+}
+
+} // namespace herlang::runtime
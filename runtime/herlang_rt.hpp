@@ -0,0 +1,241 @@
+// herlang_rt.hpp - Runtime library linked into every generated HerLang program
+// 生成的 C++ 只包含这一个头文件，实现都在预编译的 libherlang_rt 里
+
+#pragma once
+
+#include <cstddef>
+
+// Deliberately narrow: only <cstddef>, so a generated translation unit
+// compiles without any iostream, string or locale machinery. Everything
+// that does real work is defined out of line in herlang_rt.cpp.
+namespace herlang::runtime {
+
+// Program output goes through one 64 KiB buffer. It is handed to the OS
+// when it fills, at flush() and when the program exits. Inside a block
+// started by TaskGroup::spawn, output is gathered per block instead and
+// joins the program's output in one piece (see TaskGroup).
+void write(const char* data, std::size_t size);
+void flush();
+
+// First statement of every generated main(): switches the Windows console
+// to UTF-8 so HerLang strings print as written.
+void start();
+
+// Reports an integer `divide` by zero and ends the program with status 1,
+// after writing out everything printed so far.
+[[noreturn]] void division_by_zero();
+
+// `divide x y` on integers: truncates toward zero like C++, but a zero
+// divisor is a HerLang error rather than undefined behaviour, and
+// INT64_MIN / -1 wraps as the compiler's folding does.
+inline long long divide(long long a, long long b) {
+    if (b == 0) division_by_zero();
+    if (b == -1) return static_cast<long long>(0ULL - static_cast<unsigned long long>(a));
+    return a / b;
+}
+
+// Text in generated code: a string literal and its length in bytes.
+struct Str {
+    const char* ptr;
+    std::size_t len;
+
+    const char* data() const { return ptr; }
+    std::size_t size() const { return len; }
+};
+
+// One piece of a `say` line: text, or a number still to be formatted.
+// Generated code writes literal text as { "...", length }, so its length
+// is fixed at compile time and nothing is measured at run time.
+struct Piece {
+    enum Kind : unsigned char { Text, CText, Int, Uint, Float };
+
+    constexpr Piece(const char* p, std::size_t n) : kind(Text), text{ p, n } {}
+    constexpr Piece(Str s) : kind(Text), text(s) {}
+    constexpr Piece(const char* s) : kind(CText), c_text(s) {}
+    constexpr Piece(int v) : kind(Int), i(v) {}
+    constexpr Piece(long v) : kind(Int), i(v) {}
+    constexpr Piece(long long v) : kind(Int), i(v) {}
+    constexpr Piece(unsigned v) : kind(Uint), u(v) {}
+    constexpr Piece(unsigned long v) : kind(Uint), u(v) {}
+    constexpr Piece(unsigned long long v) : kind(Uint), u(v) {}
+    constexpr Piece(double v) : kind(Float), f(v) {}
+
+    // Any string type with data() and size(), std::string included,
+    // without this header having to include it.
+    template <typename S>
+    constexpr Piece(const S& s, decltype(s.data(), s.size(), 0) = 0) : kind(Text), text{ s.data(), s.size() } {}
+
+    Kind kind;
+    union {
+        Str text;
+        const char* c_text;
+        long long i;
+        unsigned long long u;
+        double f;
+    };
+};
+
+// A `say` with variables in it: the pieces of the line, ending included,
+// are copied and formatted into a buffer on the stack and written with a
+// single write(). Integers print in full and doubles with six significant
+// digits, as std::cout prints them by default.
+// Only a line longer than the stack buffer is written piece by piece.
+void say(const Piece* pieces, std::size_t count);
+
+template <std::size_t N>
+void say(const Piece (&pieces)[N]) { say(pieces, N); }
+
+// The text tests of a filter_gently stage.
+bool equals(Str text, Str other);
+bool contains(Str text, Str part);
+bool starts_with(Str text, Str prefix);
+bool ends_with(Str text, Str suffix);
+
+// Calls task(context, i) for every i below `count` and returns once all of
+// them have finished. The calls are shared between the calling thread and
+// a pool of worker threads, one per further CPU core and at least one,
+// started on first use.
+void parallel_for(std::size_t count, void (*task)(void* context, std::size_t index), void* context);
+
+// `yield_kindly`: flushes the output, then sleeps for `milliseconds` while
+// the rest of the program goes on running. Other spawned blocks run in the
+// meantime on any worker that is free; with every worker busy or asleep,
+// they wait for one, or for a thread in TaskGroup::wait() to take them.
+void pause(unsigned milliseconds);
+
+// The blocks a function or the start block starts with `spawn_gently`.
+// Each runs once on the parallel_for worker pool, or on a thread waiting in
+// wait(), working on the copies its lambda captured. What a block prints
+// is kept back until it finishes, pauses or flushes, and is then added to
+// the program's output in one piece, so the lines of different blocks
+// never mix. wait() returns once every block spawned so far has finished;
+// so does the destructor.
+class TaskGroup {
+public:
+    TaskGroup() = default;
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+    ~TaskGroup() { wait(); }
+
+    template <typename F>
+    void spawn(F body) {
+        start(new F(static_cast<F&&>(body)), [](void* task) {
+            F* body = static_cast<F*>(task);
+            (*body)();
+            delete body;
+        });
+    }
+
+    void wait();
+
+private:
+    void start(void* task, void (*run)(void* task));
+
+    std::size_t pending_ = 0;   // spawned and not yet finished; guarded by the pool
+};
+
+// Heap blocks for List. Running out of memory ends the program with an
+// error, so allocate() never returns null for a non-zero size.
+void* allocate(std::size_t bytes);
+void release(void* block);
+
+// A HerLang list: elements back to back in one heap block, so iterating
+// over it is a linear walk the C++ compiler can vectorize. Elements are
+// trivially copyable (Str, long long, double) and are copied by plain
+// assignment.
+template <typename T>
+class List {
+public:
+    List() = default;
+
+    // A list literal: exactly `count` elements of capacity, filled once.
+    List(const T* items, std::size_t count) {
+        reserve(count);
+        for (std::size_t i = 0; i < count; ++i) data_[i] = items[i];
+        size_ = count;
+    }
+
+    List(const List&) = delete;
+    List& operator=(const List&) = delete;
+    ~List() { release(data_); }
+
+    void reserve(std::size_t capacity) {
+        if (capacity <= capacity_) return;
+        T* grown = static_cast<T*>(allocate(capacity * sizeof(T)));
+        for (std::size_t i = 0; i < size_; ++i) grown[i] = data_[i];
+        release(data_);
+        data_ = grown;
+        capacity_ = capacity;
+    }
+
+    void push(const T& value) {
+        if (size_ == capacity_) reserve(capacity_ ? capacity_ * 2 : 8);
+        data_[size_++] = value;
+    }
+
+    // Fills an empty list in one pass over `source`: stage(element, out)
+    // stores what an element becomes in `out` and returns whether to keep
+    // it, so a chain of filters and calculations builds no lists in
+    // between. Room for every element is reserved first and is the only
+    // allocation. A large source is cut into chunks that fill their own
+    // slices in parallel, which are then closed up in order; with
+    // `parallel` false every element is taken on the calling thread.
+    template <typename S, typename F>
+    void fill(const List<S>& source, F stage, bool parallel = true) {
+        std::size_t count = source.size();
+        reserve(count);
+        std::size_t chunks = count / kChunkElements;
+        if (chunks < 2 || !parallel) {
+            size_ = fill_range(source.begin(), count, data_, stage);
+            return;
+        }
+        if (chunks > kMaxChunks) chunks = kMaxChunks;
+
+        struct Job {
+            const S* in;
+            T* out;
+            std::size_t count;
+            std::size_t chunks;
+            const F* stage;
+            std::size_t kept[kMaxChunks];
+        };
+        Job job{ source.begin(), data_, count, chunks, &stage, {} };
+        parallel_for(chunks, [](void* context, std::size_t chunk) {
+            Job& job = *static_cast<Job*>(context);
+            std::size_t begin = job.count * chunk / job.chunks;
+            std::size_t end = job.count * (chunk + 1) / job.chunks;
+            job.kept[chunk] = fill_range(job.in + begin, end - begin, job.out + begin, *job.stage);
+        }, &job);
+
+        size_ = job.kept[0];
+        for (std::size_t chunk = 1; chunk < chunks; ++chunk) {
+            const T* kept = data_ + count * chunk / chunks;
+            for (std::size_t i = 0; i < job.kept[chunk]; ++i) data_[size_++] = kept[i];
+        }
+    }
+
+    std::size_t size() const { return size_; }
+    const T& operator[](std::size_t i) const { return data_[i]; }
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+
+private:
+    // Sources shorter than two chunks are filled on the calling thread.
+    static constexpr std::size_t kChunkElements = 1 << 15;
+    static constexpr std::size_t kMaxChunks = 64;
+
+    template <typename S, typename F>
+    static std::size_t fill_range(const S* in, std::size_t count, T* out, const F& stage) {
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            if (stage(in[i], out[kept])) ++kept;
+        }
+        return kept;
+    }
+
+    T* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t capacity_ = 0;
+};
+
+} // namespace herlang::runtime
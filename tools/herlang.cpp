@@ -6,10 +6,19 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <set>
 #include <filesystem>
 #include <chrono>
 #include <regex>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+#include <iterator>
+
+#include "cache.hpp"
+#include "driver.hpp"
+#include "keywords.hpp"
 
 namespace fs = std::filesystem;
 using namespace std;
@@ -20,6 +29,7 @@ struct BuildConfig {
     string target_arch = "native";
     string optimization = "release";
     string output_dir = "build";
+    unsigned max_threads = 0;           // 0: 跟随 CPU 核心数 ("auto")
     bool hot_reload = true;
     bool friendly_errors = true;
     vector<string> dependencies;
@@ -57,6 +67,14 @@ public:
                 config.project_name = extract_quoted_value(line);
             } else if (line.find("target = ") != string::npos) {
                 config.target_arch = extract_quoted_value(line);
+            } else if (line.find("optimization = ") != string::npos) {
+                config.optimization = extract_quoted_value(line);
+            } else if (line.find("output_dir = ") != string::npos) {
+                config.output_dir = extract_quoted_value(line);
+            } else if (line.find("max_threads = ") != string::npos) {
+                // "auto" 或一个数字，可以不带引号
+                string value = extract_setting(line);
+                config.max_threads = value == "auto" ? 0 : static_cast<unsigned>(strtoul(value.c_str(), nullptr, 10));
             }
         }
         
@@ -132,23 +150,14 @@ public:
         
         string line;
         int line_num = 1;
-        vector<string> keywords = {"function", "gentle_function", "if", "gently_if", 
-                                  "loop", "gentle_loop", "say", "whisper", "share"};
-        
+
         while (getline(file, line)) {
             // 检查缩进
             if (!line.empty() && line[0] != ' ' && line[0] != '\t' && 
                 line.find(':') == string::npos && line != "end" && line != "start:") {
                 
-                bool is_keyword = false;
-                for (const auto& kw : keywords) {
-                    if (line.find(kw) == 0) {
-                        is_keyword = true;
-                        break;
-                    }
-                }
-                
-                if (!is_keyword) {
+                // 与编译器共用同一张关键字表
+                if (!leading_keyword(line)) {
                     friendly_error(source_file, line_num, 1, "缩进温馨提示",
                                   "这行代码可能需要适当的缩进",
                                   "HerLang 使用优雅的缩进来表示代码结构，就像诗歌的韵律");
@@ -178,11 +187,16 @@ public:
         // 创建输出目录
         fs::create_directories(config.output_dir);
         
-        // 查找所有 .herc 文件
+        // 查找所有 .herc 文件（跳过输出目录本身）
         vector<string> source_files;
-        for (const auto& entry : fs::recursive_directory_iterator(".")) {
-            if (entry.path().extension() == ".herc") {
-                source_files.push_back(entry.path().string());
+        fs::path output_dir = fs::absolute(config.output_dir).lexically_normal();
+        for (auto it = fs::recursive_directory_iterator("."); it != fs::recursive_directory_iterator(); ++it) {
+            if (it->is_directory() && fs::absolute(it->path()).lexically_normal() == output_dir) {
+                it.disable_recursion_pending();
+                continue;
+            }
+            if (it->path().extension() == ".herc") {
+                source_files.push_back(it->path().string());
             }
         }
         
@@ -208,14 +222,16 @@ public:
         }
         
         // 生成最终可执行文件
-        generate_executable();
+        if (!generate_executables(source_files)) {
+            cout << "\n💝 构建暂停，请修复上述问题后再试" << endl;
+            return;
+        }
         
         auto end_time = chrono::high_resolution_clock::now();
         auto duration = chrono::duration_cast<chrono::milliseconds>(end_time - start_time);
         
         cout << "\n✨ 构建成功完成！" << endl;
         cout << "⏱️  耗时: " << duration.count() << "ms" << endl;
-        cout << "🎉 可执行文件: " << config.output_dir << "/" << config.project_name << endl;
         cout << "\n💖 愿你的代码如花般绽放！" << endl;
     }
 
@@ -241,7 +257,7 @@ hot_reload = true
         ofstream hello("hello.herc");
         hello << R"(gentle_function greet_world:
     say "🌸 你好，温柔的世界！"
-    whisper "编程可以是如此美好的体验"
+    say "💭 编程可以是如此美好的体验"
 end
 
 gentle_function inspire:
@@ -257,40 +273,187 @@ end
         cout << "🌸 已创建示例文件 hello.herc" << endl;
     }
 
-    void generate_executable() {
-        // 这里将调用实际的编译器后端
+    // 一个翻译单元：一个 .herc 生成的 C++，编译成一个目标文件；
+    // 带 start 块的单元再链接成自己的可执行文件。
+    struct BuildUnit {
+        string source;
+        string name;           // 由相对路径展平而来，gen/obj 文件和可执行文件都用它命名
+        string cpp;
+        string object;
+        string executable;     // 空：没有 start 块，只编译不链接
+        bool cached = false;
+        bool ok = false;
+        string log;
+    };
+
+    string cxx_command() const {
+        const char* cxx = getenv("CXX");
+        return cxx && *cxx ? cxx : "g++";
+    }
+
+    string cxx_flags() const {
+        string flags = config.optimization == "debug" ? "-std=c++17 -O0 -g" : "-std=c++17 -O2";
+        return flags + " -I\"" + runtime_include_dir() + "\"";
+    }
+
+    // 生成的代码依赖 libherlang_rt；默认使用与本工具一起构建的那一份
+    static string runtime_include_dir() {
+        const char* dir = getenv("HERLANG_RT_INCLUDE_DIR");
+        return dir && *dir ? dir : HERLANG_RT_INCLUDE_DIR;
+    }
+
+    static string runtime_library() {
+        const char* lib = getenv("HERLANG_RT_LIBRARY");
+        return lib && *lib ? lib : HERLANG_RT_LIBRARY;
+    }
+
+    unsigned thread_count(size_t jobs) const {
+        unsigned threads = config.max_threads ? config.max_threads : thread::hardware_concurrency();
+        return static_cast<unsigned>(min<size_t>(max(threads, 1u), jobs));
+    }
+
+    // 在最多 thread_count() 个线程上并行执行 work(i)
+    template <typename Work>
+    void parallel_for(size_t count, Work work) const {
+        atomic<size_t> next{ 0 };
+        auto worker = [&]() {
+            for (size_t i = next++; i < count; i = next++) work(i);
+        };
+        vector<thread> pool;
+        for (unsigned t = 1; t < thread_count(count); ++t) pool.emplace_back(worker);
+        worker();
+        for (auto& th : pool) th.join();
+    }
+
+    static string read_all(const string& path) {
+        ifstream in(path, ios::binary);
+        return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+
+    // 运行一条命令，输出收集到 log_path，返回是否成功
+    static bool run_logged(const string& command, const string& log_path, string& log) {
+        int status = system((command + " > \"" + log_path + "\" 2>&1").c_str());
+        log = read_all(log_path);
+        return status == 0;
+    }
+
+    // 目标文件按生成的 C++ 与编译命令的哈希缓存，没变的单元不会重新编译
+    void compile_unit(BuildUnit& unit, const CompileCache& objects) const {
+        // 运行时头文件的内容也算在键里：它变了，目标文件就得重新编译
+        string flags = cxx_command() + " " + cxx_flags();
+        string key = CompileCache::key_for(read_all(unit.cpp),
+            flags + '\0' + read_all(runtime_include_dir() + "/herlang_rt.hpp"));
+        string ignored;
+        unit.cached = objects.fetch(key, unit.object, ignored);
+        if (!unit.cached) {
+            string command = flags + " -c \"" + unit.cpp + "\" -o \"" + unit.object + "\"";
+            if (!run_logged(command, unit.object + ".log", unit.log)) return;
+            objects.store(key, unit.object, {});
+        }
+
+        if (!unit.executable.empty()) {
+            string command = cxx_command() + " \"" + unit.object + "\" \"" + runtime_library() +
+                "\" -pthread -o \"" + unit.executable + "\"";
+            string link_log;
+            if (!run_logged(command, unit.object + ".link.log", link_log)) {
+                unit.log += link_log;
+                return;
+            }
+        }
+        unit.ok = true;
+    }
+
+    bool generate_executables(const vector<string>& sources) {
         cout << "🔧 生成可执行文件..." << endl;
-        
-        // 创建 C++ 输出文件
-        ofstream cpp_out(config.output_dir + "/main.cpp");
-        cpp_out << R"(#include <iostream>
-#include <string>
 
-void say(const std::string& message) {
-    std::cout << message << std::endl;
-}
+        fs::path out_dir = config.output_dir;
+        fs::create_directories(out_dir / "gen");
+        fs::create_directories(out_dir / "obj");
 
-void whisper(const std::string& message) {
-    std::cout << "💭 " << message << std::endl;
-}
+        // 1. .herc -> C++，由 hcp 的驱动并行完成，并复用它的 C++ 缓存
+        vector<CompileJob> jobs;
+        vector<BuildUnit> units;
+        map<string, string> claimed;   // 展平后的名字 -> 源文件
+        for (const auto& source : sources) {
+            // 用相对路径命名，避免不同目录下的同名文件互相覆盖
+            string name = fs::path(source).lexically_normal().replace_extension().string();
+            replace_if(name.begin(), name.end(), [](char c) { return c == '/' || c == '\\' || c == '.'; }, '_');
+            BuildUnit unit;
+            unit.source = source;
+            unit.name = name;
+            unit.cpp = (out_dir / "gen" / (name + ".cpp")).string();
+            unit.object = (out_dir / "obj" / (name + ".o")).string();
+            auto [it, fresh] = claimed.emplace(name, source);
+            if (!fresh) {
+                cout << "💔 " << it->second << " 和 " << source << " 会生成同名文件 " << name
+                     << "，请给其中一个改个名字" << endl;
+                return false;
+            }
+            units.push_back(unit);
+            jobs.push_back({ source, unit.cpp });
+        }
 
-int main() {
-    say("🌸 你好，温柔的世界！");
-    whisper("编程可以是如此美好的体验");
-    say("💝 你有能力创造美好的事物");
-    say("🌟 相信自己，勇敢前行");
-    return 0;
-}
-)";
-        cpp_out.close();
-        
-        // 编译 C++ 代码
-        string compile_cmd = "g++ -std=c++17 -O2 " + config.output_dir + "/main.cpp -o " + 
-                           config.output_dir + "/" + config.project_name;
-        system(compile_cmd.c_str());
+        CompileOptions options;
+        options.cache_dir = (out_dir / "cache" / "cpp").string();
+        auto results = compile_all(jobs, thread_count(jobs.size()), options);
+
+        // 只有带 start 块的单元定义了 main()；只有一个时它就是项目本身
+        bool generated = true;
+        vector<BuildUnit*> programs;
+        for (size_t i = 0; i < units.size(); ++i) {
+            cerr << results[i].diagnostics;
+            if (!results[i].ok) {
+                cout << "💔 " << units[i].source << " 无法生成 C++" << endl;
+                generated = false;
+            } else if (results[i].has_start) {
+                programs.push_back(&units[i]);
+            }
+        }
+        if (!generated) return false;
+
+        // 可执行文件放在输出目录里，不能和它的子目录或彼此重名
+        set<string> taken = { "gen", "obj", "cache" };
+        for (BuildUnit* unit : programs) {
+            string name = programs.size() == 1 && !config.project_name.empty() ? config.project_name : unit->name;
+            if (!taken.insert(name).second) {
+                cout << "💔 " << unit->source << " 的可执行文件名 " << name
+                     << " 已被占用，请给它或项目换个名字" << endl;
+                return false;
+            }
+            unit->executable = (out_dir / name).string();
+        }
+
+        // 2. C++ -> 目标文件 -> 可执行文件，每个单元一个并行任务
+        CompileCache objects((out_dir / "cache" / "obj").string(), ".o");
+        parallel_for(units.size(), [&](size_t i) { compile_unit(units[i], objects); });
+
+        bool success = true;
+        for (const auto& unit : units) {
+            if (!unit.ok) {
+                cout << "💔 " << unit.source << " 编译失败" << endl << unit.log;
+                success = false;
+                continue;
+            }
+            cout << (unit.cached ? "♻️  " : "✅ ") << unit.source << (unit.cached ? " (缓存)" : "");
+            if (!unit.executable.empty()) cout << " -> " << unit.executable;
+            cout << endl;
+        }
+        return success;
     }
 
 private:
+    // 等号后面的值，去掉引号和行尾注释
+    string extract_setting(const string& line) {
+        size_t eq = line.find('=');
+        if (eq == string::npos) return "";
+        string value = line.substr(eq + 1);
+        if (value.find('"') != string::npos) return extract_quoted_value(value);
+        value = value.substr(0, value.find('#'));
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t\r") + 1);
+        return value;
+    }
+
     string extract_quoted_value(const string& line) {
         size_t start = line.find('"');
         size_t end = line.rfind('"');